@@ -100,11 +100,7 @@ void eeprom_25aa02e48_read(unsigned char *pointer, const unsigned char address,
     eeprom_cs_assert();         // Select device
     ssp2_put(INST_READ);        // Send read instruction
     ssp2_put(address);          // Send address
-    while(length > 0) {
-        *pointer = ssp2_get();  // Read databyte
-        pointer++;
-        length--;
-    }
+    ssp2_read_block(pointer, length); // Read data
     eeprom_cs_deassert();       // Deselect device
 }
 
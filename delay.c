@@ -48,6 +48,24 @@ void delay_ms(volatile unsigned int time)
 }
 #endif
 
+#ifdef __HOST
+void delay_us(unsigned int time)
+/*!
+  Delay of 'time' microseconds; time passes on the emulated peripherals only
+*/
+{
+    host_cycles((unsigned long)time * HOST_CYCLES_PER_US);
+}
+
+void delay_ms(unsigned int time)
+/*!
+  Delay of 'time' milliseconds
+*/
+{
+    host_cycles((unsigned long)time * HOST_CYCLES_PER_US * 1000);
+}
+#endif
+
 void delay_s(volatile unsigned int time)
 /*!
   Delay of approximately 'time' seconds
@@ -29,6 +29,8 @@ ENC28J60 driver
 /* Which ssp interface to use? */
 #define encspi_put(data)     ssp2_put(data)
 #define encspi_get()         ssp2_get()
+#define encspi_write_block(data, length) ssp2_write_block(data, length)
+#define encspi_read_block(data, length)  ssp2_read_block(data, length)
 
 /* SPI command set */
 /* Read/Write any of the ETH, MAC and MII registers */
@@ -43,28 +45,60 @@ ENC28J60 driver
 /* Software reset */
 #define CMD_SC          0xFF    /* Soft Reset */
 
+/* System ticks (10ms) to wait for the DMA engine, or for a packet that's coming in; both
+   take less than 2ms */
+#define ENC28J60_DMA_TIMEOUT    2
+extern volatile unsigned char system_ticks;
+
 /* Local functions */
 static void bankselect(const unsigned char bank);
+static void writepointer(const unsigned char address, const unsigned short value, unsigned short *shadow);
+static unsigned short advancepointer(const unsigned short pointer, const unsigned short length);
 static void setcontrolbit(const unsigned char address, const unsigned char bank, const unsigned char bitmask);
 static void clearcontrolbit(const unsigned char address, const unsigned char bank, const unsigned char bitmask);
 static unsigned char readcontrolregister(const unsigned char address);
 static void writecontrolregister(const unsigned char address, const unsigned char value);
 static unsigned short readphyregister(const unsigned char address);
 static void writephyregister(const unsigned char address, const unsigned short value);
-static void readbuffermemory(unsigned char *data, unsigned short length);
+static void readbuffermemory(unsigned char *data, const unsigned short length);
+static void transmit(void);
+static void freememory(void);
+static unsigned short txallocate(const unsigned short length);
+static void applyfilter(void);
+static void setpattern(const unsigned char mask[8], const unsigned char *pattern, const unsigned char length);
 
 /* Local variables */
 static unsigned char currentbank;               /* The currently selected register-bank */
+/* Shadows of the 16 bit pointer registers in bank 0, as last written or as moved by the controller
+   since; writepointer() skips what's unchanged. POINTER_UNKNOWN when we don't know */
+#define POINTER_UNKNOWN     0xFFFF
+static unsigned short erdpt, ewrpt, etxst, etxnd, edmast, edmand;
+static unsigned char rxfilter;                  /* Receive filters in use; see enc28j60_setfilter() */
+static unsigned char rxfilteraddress[4];        /* IP address ENC28J60_FILTER_ARP looks for; see enc28j60_setaddress() */
 static bool halfduplex;                         /* TRUE when in half duplex mode, FALSE when in full duplex mode; see enc28j60_setduplex() */
-static unsigned short txstatusvectorlocation;   /* Where to read the statusvector when the transmission is completed; see enc28j60_put() */
 static bool linkstate;                          /* Link up or down? Updated in enc28j60_int() */
-static unsigned char pendingpackets;            /* No. of pending packets. Incremented in enc28j60_int(), decremented in enc28j60_get() */
-static bool bufferfull;                         /* TRUE when buffer is full; set in enc28j60_int(), cleared in enc28j60_get() */
-static volatile bool transmitting;              /* Set by enc28j60_put(), cleared in enc28j60_int() when the transmission completes. NOTE: volatile, because optimization breaks the logic in enc28j60_put() */
-static unsigned char txstatusvector[7];         /* The last received TX-statusvector is stored here */
+static unsigned char pendingpackets;            /* No. of pending packets. Incremented in enc28j60_int(), decremented in enc28j60_get_done() */
+static bool bufferfull;                         /* TRUE when buffer is full; set in enc28j60_int(), cleared in enc28j60_get_done() */
+static unsigned short packetpointer;            /* Where the next packet to read starts in the Rx buffer */
+static unsigned short rxpacket;                 /* Start of the data of the packet being read; see enc28j60_get_header() */
+static unsigned short rxlength;                 /* Its length.. */
+static unsigned short rxread;                   /* ..and how much of it is read */
+static bool rxheld;                             /* TRUE when Rx buffer memory is kept; see enc28j60_get_hold() */
+static unsigned char txstatusvector[TXSTATUSVECTORLENGTH]; /* The last received TX-statusvector is stored here */
+
+/* Transmit queue; packets are added by enc28j60_put_transmit(), and removed in enc28j60_int() when
+   their transmission completes. The first one is the one being transmitted. NOTE: head and count are
+   volatile, because enc28j60_put_wait() and enc28j60_put() wait for enc28j60_int() to change them */
+static struct {
+    unsigned short location;                    /* Start of the packet, its control byte, in controller RAM */
+    unsigned short length;                      /* Packet length, without the control byte */
+} txqueue[ENC28J60_TXQUEUE_LENGTH];
+static volatile unsigned char txqueue_head;
+static volatile unsigned char txqueue_count;
+static unsigned short txnext;                   /* Where enc28j60_put() tries to put the next packet in the transmitbuffer */
 static unsigned char rxstatusvector[6];         /* The last received RX-statusvector is stored here */
 
-bool enc28j60_init(const unsigned char MAC[8])
+bool enc28j60_init(const unsigned char MAC[6])
 /*!
   Initialize the ENC28J60 in half-duplex mode with the given MAC address.
   
@@ -75,6 +109,13 @@ bool enc28j60_init(const unsigned char MAC[8])
 
     /* We start in bank 0 */
     currentbank = BANK0;
+    /* Pointer registers are reset as well; don't bother about their reset values */
+    erdpt = POINTER_UNKNOWN;
+    ewrpt = POINTER_UNKNOWN;
+    etxst = POINTER_UNKNOWN;
+    etxnd = POINTER_UNKNOWN;
+    edmast = POINTER_UNKNOWN;
+    edmand = POINTER_UNKNOWN;
 
     /* Reset chip with a soft-reset */
     enc28j60_reset_deassert();
@@ -109,8 +150,11 @@ bool enc28j60_init(const unsigned char MAC[8])
     /* Reception read pointer */
     writecontrolregister(ERXRDPTL, RXSTART & 0xFF);
     writecontrolregister(ERXRDPTH, (RXSTART>>8) & 0xFF);
-    /* Receive filter; only accept packets with our MAC or the broadcast MAC as destination and a valid CRC */
-    writecontrolregister(ERXFCON, ERXFCON_ANDOR | ERXFCON_BCEN | ERXFCON_UCEN | ERXFCON_CRCEN);
+    /* Receive filter; only accept packets with our MAC as destination and a valid CRC, until
+       we're told what else we're interested in */
+    rxfilter = ENC28J60_FILTER_ARP;
+    memset(rxfilteraddress, 0, sizeof(rxfilteraddress));
+    applyfilter();
 
     /* Initialize the MAC
        First get it out of reset */
@@ -165,7 +209,12 @@ bool enc28j60_init(const unsigned char MAC[8])
     /* No packets pending either */
     pendingpackets = 0;
     bufferfull = FALSE;
-    transmitting = FALSE;
+    packetpointer = RXSTART;
+    rxheld = FALSE;
+    /* And nothing to transmit */
+    txqueue_head = 0;
+    txqueue_count = 0;
+    txnext = TXSTART;
 
     /* Enable interrupts (all except for WOLIE) */
     writephyregister(PHIE, PHIE_PLNKIE | PHIE_PGEIE);
@@ -211,6 +260,38 @@ void enc28j60_setduplex(const bool full)
     enc28j60_int_resume();
 }
 
+void enc28j60_setfilter(const unsigned char filter)
+/*!
+  Select which frames, besides those sent to our MAC, to receive; a combination of the
+  ENC28J60_FILTER_* flags. Everything else, broadcasts in particular, is dropped by the
+  controller and never takes up receivebuffer memory or SPI time
+*/
+{
+    if(filter == rxfilter) {
+        return;
+    }
+
+    enc28j60_int_suspend();
+    rxfilter = filter;
+    applyfilter();
+    enc28j60_int_resume();
+}
+
+void enc28j60_setaddress(const unsigned char ipaddr[4])
+/*!
+  Set the IP address ENC28J60_FILTER_ARP filters on; 0.0.0.0 when we don't have one
+*/
+{
+    if(memcmp(ipaddr, rxfilteraddress, sizeof(rxfilteraddress)) == 0) {
+        return;
+    }
+
+    enc28j60_int_suspend();
+    memcpy(rxfilteraddress, ipaddr, sizeof(rxfilteraddress));
+    applyfilter();
+    enc28j60_int_resume();
+}
+
 bool enc28j60_link(void)
 /*!
   Get current linkstate
@@ -221,15 +302,45 @@ bool enc28j60_link(void)
 
 void enc28j60_put_transmit(const unsigned short location, const unsigned short length)
 /*!
-  Transmit packet of 'length' bytes from controller RAM, stored at 'location'
+  Queue packet of 'length' bytes, stored at 'location' in controller RAM, for transmission.
+  The controller writes the statusvector right after the packet, so the TXSTATUSVECTORLENGTH
+  bytes there should not be in use by another packet in the queue.
+  Call with the interrupt suspended, and after enc28j60_put_wait() made sure there's room
+  in the queue
+*/
+{
+    unsigned char i;
+
+    i = txqueue_head + txqueue_count;
+    if(i >= ENC28J60_TXQUEUE_LENGTH) {
+        i -= ENC28J60_TXQUEUE_LENGTH;
+    }
+    txqueue[i].location = location;
+    txqueue[i].length = length;
+    txqueue_count++;
+
+    #ifdef ENC28J60_DEBUG
+    dprint("enc28j60_put_transmit(): queued %d bytes from 0x%x, %d in queue\n\r", length, location, txqueue_count);
+    #endif
+
+    if(txqueue_count == 1) {
+        /* Nothing being transmitted; start right away */
+        transmit();
+    }
+}
+
+static void transmit(void)
+/*!
+  Start transmission of the packet at the head of the transmit queue
 */
 {
-    /* Set address of packet end */
-    writecontrolregister(ETXNDL, (location + length) & 0xFF);
-    writecontrolregister(ETXNDH, ((location + length)>>8) & 0xFF);
+    unsigned short location = txqueue[txqueue_head].location;
+    unsigned short length = txqueue[txqueue_head].length;
 
-    /* Statusvector will be written here when transmission is done */
-    txstatusvectorlocation = location + length + 1;
+    /* Set address of packet start.. */
+    writepointer(ETXSTL, location, &etxst);
+    /* ..and end */
+    writepointer(ETXNDL, location + length, &etxnd);
 
     /* Reset the internal transmit logic before attempting to transmit a packet
        (see Erreta rev. B7, note 12)
@@ -243,13 +354,88 @@ void enc28j60_put_transmit(const unsigned short location, const unsigned short l
 
     /* Start transmission */
     #ifdef ENC28J60_DEBUG
-    dprint("enc28j60_put_transmit(): start, %d bytes from 0x%x\n\r", length, location);
+    dprint("transmit(): start, %d bytes from 0x%x\n\r", length, location);
     #endif
-    transmitting = TRUE;
     setcontrolbit(ECON1, BANKDONTCARE, ECON1_TXRTS);
 }
 
-void enc28j60_put_copydata(unsigned char *data, const unsigned short length)
+static unsigned short txallocate(const unsigned short length)
+/*!
+  Find room for a packet of 'length' bytes in the transmitbuffer, next to the packets that
+  are still in the transmit queue. A packet takes a control byte, the packet itself and the
+  statusvector. Returns its location, or 0 when there's no room right now.
+  Call with the interrupt suspended
+*/
+{
+    unsigned short size = 1 + length + TXSTATUSVECTORLENGTH;
+    unsigned short oldest = 0;
+    unsigned short location;
+    unsigned char i, j;
+
+    /* Find the oldest queued packet in the transmitbuffer; the ones in the free buffer
+       (see enc28j60_freebuffer.h) don't matter here */
+    i = txqueue_head;
+    for(j=0;j<txqueue_count;j++) {
+        if(txqueue[i].location >= TXSTART) {
+            oldest = txqueue[i].location;
+            break;
+        }
+        i++;
+        if(i == ENC28J60_TXQUEUE_LENGTH) {
+            i = 0;
+        }
+    }
+
+    if(oldest == 0) {
+        /* Transmitbuffer is empty */
+        txnext = TXSTART;
+    }
+    else if(txnext > oldest) {
+        /* Free space is from txnext up to TXEND, and from TXSTART up to the oldest packet */
+        if(size > TXEND + 1 - txnext) {
+            if(size > oldest - TXSTART) {
+                return 0;
+            }
+            txnext = TXSTART;
+        }
+    }
+    else if(size > oldest - txnext) {
+        /* Free space is from txnext up to the oldest packet */
+        return 0;
+    }
+
+    location = txnext;
+    txnext += size;
+    return location;
+}
+
+bool enc28j60_put_queued(const unsigned short location)
+/*!
+  Is the packet at 'location' still in the transmit queue? Until it's transmitted, the
+  controller RAM it's in can't be reused
+*/
+{
+    bool queued = FALSE;
+    unsigned char i, j;
+
+    enc28j60_int_suspend();
+    i = txqueue_head;
+    for(j=0;j<txqueue_count;j++) {
+        if(txqueue[i].location == location) {
+            queued = TRUE;
+            break;
+        }
+        i++;
+        if(i == ENC28J60_TXQUEUE_LENGTH) {
+            i = 0;
+        }
+    }
+    enc28j60_int_resume();
+
+    return queued;
+}
+
+void enc28j60_put_copydata(const unsigned char *data, const unsigned short length)
 /*!
   Copy data to the controller, at location set with enc28j60_put_startofpacket() or
   optionally with enc28j60_put_setwritepointer()
@@ -257,36 +443,34 @@ void enc28j60_put_copydata(unsigned char *data, const unsigned short length)
   multiple times, each time with a part of the packet
 */
 {
-    unsigned short i=0;
-
     enc28j60_cs_assert();
     encspi_put(CMD_WBM);
-    while(i < length) {
-        encspi_put(*data);
-        data++;
-        i++;
-    }
+    ssp_profile_select(SSP_CLASS_ENC28J60_BUFFER);
+    encspi_write_block(data, length);
     enc28j60_cs_deassert();
+
+    /* Controller moved the write pointer along */
+    if(ewrpt != POINTER_UNKNOWN) {
+        ewrpt = advancepointer(ewrpt, length);
+    }
 }
 
 void enc28j60_put_startofpacket(const unsigned short location) 
 /*!
-  Set start-of-packet
+  Set start-of-packet. The transmission start pointer is set once the packet is at
+  the head of the transmit queue, see transmit()
 */
 {
-    bankselect(BANK0);
-    /* Set transmission start pointer.. */
-    writecontrolregister(ETXSTL, location & 0xFF);
-    writecontrolregister(ETXSTH, (location>>8) & 0xFF);
-    /* ..and write pointer */
-    writecontrolregister(EWRPTL, location & 0xFF);
-    writecontrolregister(EWRPTH, (location>>8) & 0xFF);
+    /* Set write pointer */
+    writepointer(EWRPTL, location, &ewrpt);
 
     /* Write per packet control byte; we use the settings as defined in MACON3 */
     enc28j60_cs_assert();
     encspi_put(CMD_WBM);
+    ssp_profile_select(SSP_CLASS_ENC28J60_BUFFER);
     encspi_put(0);
     enc28j60_cs_deassert();
+    ewrpt = advancepointer(location, 1);
 
     #ifdef ENC28J60_DEBUG
     dprint("enc28j60_put_startofpacket(): 0x%x\n\r", location);
@@ -298,40 +482,189 @@ void enc28j60_put_setwritepointer(const unsigned short location)
   Set writepointer, as used by enc28j60_put_copydata()
 */
 {
-    bankselect(BANK0);
-    /* Set transmission write pointer */
-    writecontrolregister(EWRPTL, location & 0xFF);
-    writecontrolregister(EWRPTH, (location>>8) & 0xFF);
+    /* Set transmission write pointer; often, it's already there */
+    writepointer(EWRPTL, location, &ewrpt);
 
     #ifdef ENC28J60_DEBUG
     dprint("enc28j60_put_setwritepointer(): 0x%x\n\r", location);
     #endif
 }
 
+bool enc28j60_checksum(const unsigned short location, const unsigned short length, unsigned short *checksum)
+/*!
+  Calculate the checksum over 'length' bytes at 'location' in the controller's RAM with
+  the DMA engine. Stored in 'checksum' as the 16 bit one's complement sum, in host byte
+  order, as chksum() in uip.c does; it's not complemented.
+  The DMA checksum isn't reliable while a packet is being received (see Erreta rev. B7),
+  so it's only started once the receive logic is idle. Returns FALSE when a packet came in
+  anyway, or the engine didn't finish within ENC28J60_DMA_TIMEOUT ticks; then 'checksum'
+  is of no use, and enc28j60_checksum_read() is the way to go
+*/
+{
+    unsigned char start, packets;
+    bool done = TRUE;
+
+    if(length == 0) {
+        *checksum = 0;
+        return TRUE;
+    }
+
+    enc28j60_int_suspend();
+    start = system_ticks;
+    while(readcontrolregister(ESTAT) & ESTAT_RXBUSY) {
+        if((unsigned char)(system_ticks - start) > ENC28J60_DMA_TIMEOUT) {
+            done = FALSE;
+            break;
+        }
+    }
+    if(done) {
+        bankselect(BANK1);
+        packets = readcontrolregister(EPKTCNT);
+        writepointer(EDMASTL, location, &edmast);
+        writepointer(EDMANDL, advancepointer(location, length - 1), &edmand);
+        bankselect(BANK0);
+        setcontrolbit(ECON1, BANKDONTCARE, ECON1_CSUMEN | ECON1_DMAST);
+        /* Takes a few microseconds per 100 bytes */
+        start = system_ticks;
+        while(readcontrolregister(ECON1) & ECON1_DMAST) {
+            if((unsigned char)(system_ticks - start) > ENC28J60_DMA_TIMEOUT) {
+                done = FALSE;
+                break;
+            }
+        }
+        if(done) {
+            /* The controller stores the complemented sum, big-endian */
+            *checksum = ~((readcontrolregister(EDMACSH)<<8) | readcontrolregister(EDMACSL));
+        }
+        else {
+            /* Abort it */
+            clearcontrolbit(ECON1, BANKDONTCARE, ECON1_DMAST);
+        }
+        clearcontrolbit(ECON1, BANKDONTCARE, ECON1_CSUMEN);
+        clearcontrolbit(EIR, BANKDONTCARE, EIR_DMAIF);
+        if(readcontrolregister(ESTAT) & ESTAT_RXBUSY) {
+            done = FALSE;
+        }
+        bankselect(BANK1);
+        if(readcontrolregister(EPKTCNT) != packets) {
+            done = FALSE;
+        }
+    }
+    enc28j60_int_resume();
+
+    #ifdef ENC28J60_DEBUG
+    if(done) {
+        dprint("enc28j60_checksum(): %d bytes from 0x%x: 0x%x\n\r", length, location, *checksum);
+    }
+    else {
+        dprint("enc28j60_checksum(): %d bytes from 0x%x: failed\n\r", length, location);
+    }
+    #endif
+
+    return done;
+}
+
+unsigned short enc28j60_checksum_read(const unsigned short location, const unsigned short length)
+/*!
+  Same as enc28j60_checksum(), reading the bytes over SPI and adding them up here instead
+*/
+{
+    unsigned char buffer[16];
+    unsigned short sum = 0, word, remaining, count;
+    unsigned char i;
+
+    enc28j60_int_suspend();
+    writepointer(ERDPTL, location, &erdpt);
+    for(remaining = length; remaining; remaining -= count) {
+        /* An even number of bytes, so only the last word can be half */
+        count = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        readbuffermemory(buffer, count);
+        for(i=0;i<count;i+=2) {
+            word = (buffer[i] << 8) | (i + 1 < count ? buffer[i + 1] : 0);
+            sum += word;
+            if(sum < word) {
+                sum++;
+            }
+        }
+    }
+    enc28j60_int_resume();
+
+    return sum;
+}
+
 void enc28j60_put_wait(void)
 /*!
-  Wait for a previous transmission to complete
+  Wait for room in the transmit queue. Only waits when ENC28J60_TXQUEUE_LENGTH packets
+  are queued already
 */
 {
     unsigned short i=0;
 
-    if(transmitting) {
+    if(txqueue_count == ENC28J60_TXQUEUE_LENGTH) {
         #ifdef ENC28J60_DEBUG
-        dprint("enc28j60_put_wait(): waiting for previous transmission to complete\n\r");
+        dprint("enc28j60_put_wait(): waiting for room in the transmit queue\n\r");
         #endif
-        while(transmitting) {
+        while(txqueue_count == ENC28J60_TXQUEUE_LENGTH) {
             delay_us(1);
             i++;
             if(i == 0) {
                 #ifdef ENC28J60_DEBUG
-                dprint("enc28j60_put_wait(): previous transmission timed out\n\r");
+                dprint("enc28j60_put_wait(): transmission timed out\n\r");
                 #endif
+                /* Give up on what's queued; the next transmission resets the transmit logic */
+                enc28j60_int_suspend();
+                txqueue_count = 0;
+                enc28j60_int_resume();
                 break;
             }
         }
     }
 }
 
+void enc28j60_put(unsigned char *data, const unsigned short length)
+/*!
+  Copy packet of 'length' bytes to the transmitbuffer and queue it for transmission.
+  Only waits when the transmit queue is full, or when the transmitbuffer has no room
+  left next to the packets that are queued already
+*/
+{
+    enc28j60_put_two(data, length, NULL, 0);
+}
+
+void enc28j60_put_two(const unsigned char *header, const unsigned short headerlength, const unsigned char *data, const unsigned short length)
+/*!
+  As enc28j60_put(), for a packet that's in two parts; 'headerlength' bytes at 'header',
+  followed by 'length' bytes at 'data'
+*/
+{
+    unsigned short location;
+    unsigned short i=0;
+
+    enc28j60_put_wait();
+
+    enc28j60_int_suspend();
+    while((location = txallocate(headerlength + length)) == 0) {
+        /* Let enc28j60_int() take transmitted packets off the queue */
+        enc28j60_int_resume();
+        delay_us(1);
+        enc28j60_int_suspend();
+        i++;
+        if(i == 0) {
+            #ifdef ENC28J60_DEBUG
+            dprint("enc28j60_put(): transmission timed out\n\r");
+            #endif
+            txqueue_count = 0;
+        }
+    }
+    enc28j60_put_startofpacket(location);
+    enc28j60_put_copydata(header, headerlength);
+    if(length) {
+        enc28j60_put_copydata(data, length);
+    }
+    enc28j60_put_transmit(location, headerlength + length);
+    enc28j60_int_resume();
+}
+
 unsigned char enc28j60_pendingpackets(void)
 /*!
   Amount of pending packets in the Rx buffer
@@ -353,17 +686,18 @@ unsigned char enc28j60_pendingpackets(void)
     return pendingpackets;
 }
 
-unsigned short enc28j60_get(unsigned char *packetbuffer)
+unsigned short enc28j60_get_header(unsigned char *packetbuffer, unsigned short length)
 /*!
-  Read one packet from the Rx buffer
+  Start reading the next packet from the Rx buffer; copy its first 'length' bytes (or
+  less, for a shorter packet) to 'packetbuffer'. Returns the packet length, or 0 when
+  the packet is broken.
+  Follow up with enc28j60_get_rest() for the remainder if it's needed, and always
+  with enc28j60_get_done()
 */
 {
-    static unsigned short packetpointer = RXSTART;
-    unsigned char packet_ok;
-
     if(pendingpackets == 0) {
         #ifdef ENC28J60_DEBUG
-        dprint("enc28j60_get(): no packets to read\n\r");
+        dprint("enc28j60_get_header(): no packets to read\n\r");
         #endif
         return 0;
     }
@@ -371,47 +705,91 @@ unsigned short enc28j60_get(unsigned char *packetbuffer)
     enc28j60_int_suspend();
 
     /* Set read pointer */
-    bankselect(BANK0);
-    writecontrolregister(ERDPTL, packetpointer & 0xFF);
-    writecontrolregister(ERDPTH, (packetpointer>>8) & 0xFF);
+    writepointer(ERDPTL, packetpointer, &erdpt);
 
     #ifdef ENC28J60_DEBUG
-    dprint("enc28j60_get(): read from 0x%x\n\r",packetpointer);
+    dprint("enc28j60_get_header(): read from 0x%x\n\r",packetpointer);
     #endif
 
     /* Read next packet pointer and status vector */
     readbuffermemory(rxstatusvector,6);
 
-    /* And store readpointer for the next packet */
+    /* Packet data follows the statusvector.. */
+    rxpacket = advancepointer(packetpointer, 6);
+    /* ..and store readpointer for the next packet */
     packetpointer = ( ((receptionvector_t *)&rxstatusvector[0]) )->nextpacketpointer;
 
     #ifdef ENC28J60_DEBUG
-    dprint("enc28j60_get(): nextpacketpointer: 0x%x, bytecount: %d, rxstatus: 0x%x\n\r", ((receptionvector_t *)rxstatusvector)->nextpacketpointer,
-                                                                                         ((receptionvector_t *)rxstatusvector)->bytecount,
-                                                                                         ((receptionvector_t *)rxstatusvector)->rxstatus);
+    dprint("enc28j60_get_header(): nextpacketpointer: 0x%x, bytecount: %d, rxstatus: 0x%x\n\r", ((receptionvector_t *)rxstatusvector)->nextpacketpointer,
+                                                                                                ((receptionvector_t *)rxstatusvector)->bytecount,
+                                                                                                ((receptionvector_t *)rxstatusvector)->rxstatus);
     #endif
 
     if(((receptionvector_t *)rxstatusvector)->rxstatus & RXSTATUS_OK) {
-        /* Packet OK, read contents */
-        readbuffermemory(packetbuffer, ((receptionvector_t *)rxstatusvector)->bytecount);
-        packet_ok = TRUE;
+        /* Packet OK, read (the start of) its contents */
+        rxlength = ((receptionvector_t *)rxstatusvector)->bytecount;
+        if(length > rxlength) {
+            length = rxlength;
+        }
+        readbuffermemory(packetbuffer, length);
+        rxread = length;
     }
     else {
         #ifdef ENC28J60_DEBUG
-        dprint("enc28j60_get(): RXSTATUS != OK\n\r");
+        dprint("enc28j60_get_header(): RXSTATUS != OK\n\r");
         #endif
-        packet_ok = FALSE;
+        rxlength = 0;
+        rxread = 0;
     }
 
-    /* Free memory by setting Rx packet pointer,
-       making sure RXRDPT is an odd value (see Erreta rev. B7, note 14) */
-    if(packetpointer == RXSTART) {
-        writecontrolregister(ERXRDPTL, RXEND & 0xFF);
-        writecontrolregister(ERXRDPTH, (RXEND>>8) & 0xFF);
+    enc28j60_int_resume();
+
+    return rxlength;
+}
+
+void enc28j60_get_rest(unsigned char *packetbuffer)
+/*!
+  Copy what enc28j60_get_header() left of the current packet to 'packetbuffer',
+  the same buffer as given to enc28j60_get_header()
+*/
+{
+    if(rxread < rxlength) {
+        enc28j60_int_suspend();
+        /* Read pointer is still right behind the header, usually */
+        writepointer(ERDPTL, advancepointer(rxpacket, rxread), &erdpt);
+        readbuffermemory(&packetbuffer[rxread], rxlength - rxread);
+        enc28j60_int_resume();
+        rxread = rxlength;
     }
-    else {
-        writecontrolregister(ERXRDPTL, (packetpointer-1) & 0xFF);
-        writecontrolregister(ERXRDPTH, ((packetpointer-1)>>8) & 0xFF);
+}
+
+unsigned short enc28j60_get_location(const unsigned short offset)
+/*!
+  Location in controller RAM of byte 'offset' of the current packet; for use with
+  enc28j60_get_hold(), enc28j60_read() and enc28j60_checksum()
+*/
+{
+    return advancepointer(rxpacket, offset);
+}
+
+void enc28j60_get_hold(void)
+/*!
+  Keep the current packet, and all after it, in the Rx buffer until enc28j60_release()
+  is called; enc28j60_read() can get at it in the mean time
+*/
+{
+    rxheld = TRUE;
+}
+
+void enc28j60_get_done(void)
+/*!
+  Done with the current packet; free its memory, unless something's held
+*/
+{
+    enc28j60_int_suspend();
+
+    if(!rxheld) {
+        freememory();
     }
 
     /* Decrement packet counter */
@@ -432,11 +810,126 @@ unsigned short enc28j60_get(unsigned char *packetbuffer)
     #endif
 
     enc28j60_int_resume();
+}
+
+unsigned short enc28j60_read(unsigned char *data, const unsigned short location, const unsigned short length)
+/*!
+  Copy 'length' bytes from 'location' in the Rx buffer, wrapping around at its end.
+  Returns the location right after them
+*/
+{
+    enc28j60_int_suspend();
+    writepointer(ERDPTL, location, &erdpt);
+    readbuffermemory(data, length);
+    enc28j60_int_resume();
 
-    if(packet_ok) {
-        return ( ((receptionvector_t *)&rxstatusvector[0]) )->bytecount;
+    return advancepointer(location, length);
+}
+
+void enc28j60_release(void)
+/*!
+  Free what enc28j60_get_hold() kept, and whatever was read after that
+*/
+{
+    enc28j60_int_suspend();
+    rxheld = FALSE;
+    freememory();
+    enc28j60_int_resume();
+}
+
+static void freememory(void)
+/*!
+  Free the Rx buffer memory up to the next packet to be read, by setting the Rx read pointer
+*/
+{
+    /* Make sure RXRDPT is an odd value (see Erreta rev. B7, note 14).
+       Both bytes are always written; the controller only takes ERXRDPTL once ERXRDPTH is written */
+    bankselect(BANK0);
+    if(packetpointer == RXSTART) {
+        writecontrolregister(ERXRDPTL, RXEND & 0xFF);
+        writecontrolregister(ERXRDPTH, (RXEND>>8) & 0xFF);
+    }
+    else {
+        writecontrolregister(ERXRDPTL, (packetpointer-1) & 0xFF);
+        writecontrolregister(ERXRDPTH, ((packetpointer-1)>>8) & 0xFF);
     }
-    return 0;
+}
+
+/* Pattern match filters; the frame bytes selected by the mask (bit n of mask byte m is frame
+   byte 8*m+n, counting from the destination address), and what they should be */
+static const unsigned char arpmask[8] =     {0x00, 0x30, 0x30, 0x00, 0xC0, 0x03, 0x00, 0x00};
+static const unsigned char dhcpmask[8] =    {0x00, 0x70, 0x80, 0x00, 0x30, 0x00, 0x00, 0x00};
+static const unsigned char dhcppattern[6] = {0x08, 0x00,    /* Ethertype IPv4 */
+                                             0x45,          /* Version 4, 20 bytes header */
+                                             17,            /* Protocol UDP */
+                                             0x00, 68};     /* Destination port DHCP client */
+
+static void applyfilter(void)
+/*!
+  Program ERXFCON and the pattern match filter for rxfilter. There's just the one pattern
+  match filter; when more than one filter is needed, all broadcasts are let in instead
+*/
+{
+    unsigned char erxfcon = ERXFCON_UCEN | ERXFCON_CRCEN;
+    unsigned char filter = rxfilter;
+    unsigned char pattern[8];
+
+    if(!(rxfilteraddress[0] | rxfilteraddress[1] | rxfilteraddress[2] | rxfilteraddress[3])) {
+        /* No address, so no ARP requests for it either */
+        filter &= ~ENC28J60_FILTER_ARP;
+    }
+
+    bankselect(BANK1);
+    if(filter == ENC28J60_FILTER_ARP) {
+        /* Ethertype ARP, opcode request, target IP address */
+        pattern[0] = 0x08;
+        pattern[1] = 0x06;
+        pattern[2] = 0x00;
+        pattern[3] = 0x01;
+        memcpy(&pattern[4], rxfilteraddress, sizeof(rxfilteraddress));
+        setpattern(arpmask, pattern, sizeof(pattern));
+        erxfcon |= ERXFCON_PMEN;
+    }
+    else if(filter == ENC28J60_FILTER_DHCP) {
+        setpattern(dhcpmask, dhcppattern, sizeof(dhcppattern));
+        erxfcon |= ERXFCON_PMEN;
+    }
+    else if(filter) {
+        erxfcon |= ERXFCON_BCEN;
+    }
+
+    /* OR mode; a frame is accepted when any of the enabled filters accepts it */
+    writecontrolregister(ERXFCON, erxfcon);
+}
+
+static void setpattern(const unsigned char mask[8], const unsigned char *pattern, const unsigned char length)
+/*!
+  Program the pattern match filter (bank 1 selected) with the given mask, and the checksum
+  of the 'length' pattern bytes it selects. The controller sums the selected bytes the
+  same way as the IP checksum. EPMO is left at 0
+*/
+{
+    unsigned char i;
+    unsigned short word, sum = 0;
+
+    for(i=0;i<length;i+=2) {
+        word = pattern[i] << 8;
+        if(i+1 < length) {
+            word |= pattern[i+1];
+        }
+        sum += word;
+        if(sum < word) {
+            /* End-around carry */
+            sum++;
+        }
+    }
+    sum = ~sum;
+
+    for(i=0;i<8;i++) {
+        writecontrolregister(EPMM0 + i, mask[i]);
+    }
+    writecontrolregister(EPMCSL, sum & 0xFF);
+    writecontrolregister(EPMCSH, (sum>>8) & 0xFF);
 }
 
 static void bankselect(const unsigned char bank)
@@ -451,20 +944,59 @@ static void bankselect(const unsigned char bank)
         dprint("bankselect(): switch from bank %i to bank %i\n\r",currentbank, (bank&0x03));
         #endif
 
-        enc28j60_cs_assert();
-        encspi_put(CMD_BFC | (ECON1 & REGISTERMASK));
-        encspi_put(ECON1_BSEL0 | ECON1_BSEL1);
-        enc28j60_cs_deassert();
+        /* Only clear and set the bank-select bits that need to change; that takes just
+           one of the two commands, except between bank 1 and 2 */
+        if(currentbank & ~bank & 0x03) {
+            enc28j60_cs_assert();
+            encspi_put(CMD_BFC | (ECON1 & REGISTERMASK));
+            encspi_put(currentbank & ~bank & 0x03);
+            enc28j60_cs_deassert();
+        }
 
-        enc28j60_cs_assert();
-        encspi_put(CMD_BFS | (ECON1 & REGISTERMASK));
-        encspi_put(bank&0x03);
-        enc28j60_cs_deassert();
+        if(bank & ~currentbank & 0x03) {
+            enc28j60_cs_assert();
+            encspi_put(CMD_BFS | (ECON1 & REGISTERMASK));
+            encspi_put(bank & ~currentbank & 0x03);
+            enc28j60_cs_deassert();
+        }
 
         currentbank = (bank&0x03);
     }
 }
 
+static void writepointer(const unsigned char address, const unsigned short value, unsigned short *shadow)
+/*!
+  Write a 16 bit pointer register in bank 0, low byte at 'address', with 'shadow' holding
+  what it's set to now. Bytes that don't change aren't written.
+  There's no writing both bytes in one go; the WCR command takes a single register
+*/
+{
+    if(*shadow == value) {
+        return;
+    }
+
+    bankselect(BANK0);
+    if(*shadow == POINTER_UNKNOWN || (*shadow & 0xFF) != (value & 0xFF)) {
+        writecontrolregister(address, value & 0xFF);
+    }
+    if(*shadow == POINTER_UNKNOWN || (*shadow>>8) != (value>>8)) {
+        writecontrolregister(address + 1, (value>>8) & 0xFF);
+    }
+    *shadow = value;
+}
+
+static unsigned short advancepointer(const unsigned short pointer, const unsigned short length)
+/*!
+  Where the read or write pointer ends up after accessing 'length' bytes of buffer memory from
+  'pointer' on; like the controller, wrap from RXEND to RXSTART within the reception buffer
+*/
+{
+    if(pointer <= RXEND && pointer + length > RXEND) {
+        return pointer + length - (RXEND - RXSTART + 1);
+    }
+    return (pointer + length) & 0x1FFF;
+}
+
 static void setcontrolbit(const unsigned char address, const unsigned char bank, const unsigned char bitmask)
 /*!
   Set bits in the given ETH register (indeed, this only works on ETH registers!)
@@ -590,7 +1122,7 @@ static void writephyregister(const unsigned char address, const unsigned short v
     writecontrolregister(MIWRH, (value>>8) & 0xFF);
 }
 
-static void readbuffermemory(unsigned char *data, unsigned short length)
+static void readbuffermemory(unsigned char *data, const unsigned short length)
 /*!
   Read data from the reception buffer
 */
@@ -601,12 +1133,14 @@ static void readbuffermemory(unsigned char *data, unsigned short length)
 
     enc28j60_cs_assert();
     encspi_put(CMD_RBM);
-    while(length) {
-        *data = encspi_get();
-        data++;
-        length--;
-    }
+    ssp_profile_select(SSP_CLASS_ENC28J60_BUFFER);
+    encspi_read_block(data, length);
     enc28j60_cs_deassert();
+
+    /* Controller moved the read pointer along */
+    if(erdpt != POINTER_UNKNOWN) {
+        erdpt = advancepointer(erdpt, length);
+    }
 }
 
 void enc28j60_int(void)
@@ -615,6 +1149,7 @@ void enc28j60_int(void)
 */
 {
     unsigned char flags;
+    unsigned short location;
 
     /* Clear global interrupt-enable bit, this'll cause the INT-pin to de-assert.
        We re-enable this before leaving the interrupt-handler */
@@ -655,19 +1190,25 @@ void enc28j60_int(void)
         if(flags & EIR_TXIF) {
             /* Transmit request has ended; clear flag */
             clearcontrolbit(EIR, BANKDONTCARE, EIR_TXIF);
-            /* And read the statusvector. First set read pointer */
-            bankselect(BANK0);
-            writecontrolregister(ERDPTL, txstatusvectorlocation & 0xFF);
-            writecontrolregister(ERDPTH, (txstatusvectorlocation>>8) & 0xFF);
+            /* And read the statusvector, right after the packet. First set read pointer */
+            location = txqueue[txqueue_head].location + txqueue[txqueue_head].length + 1;
+            writepointer(ERDPTL, location, &erdpt);
             /* Now read data */
-            readbuffermemory(txstatusvector, 7);
+            readbuffermemory(txstatusvector, TXSTATUSVECTORLENGTH);
             #ifdef ENC28J60_DEBUG
             dprint("enc28j60_int(): Transmission complete, bytes in packet: %i, bytes on wire: %i\n\r",((transmissionvector_t *)txstatusvector)->bytecount, 
                                                                                                        ((transmissionvector_t *)txstatusvector)->bytecountraw);
             dprint("                txstatus1: 0x%x, txstatus2: 0x%x\n\r", ((transmissionvector_t *)txstatusvector)->txstatus1,
                                                                            ((transmissionvector_t *)txstatusvector)->txstatus2);
             #endif
-            transmitting = FALSE;
+            /* Done with this one */
+            if(txqueue_count) {
+                txqueue_count--;
+                txqueue_head++;
+                if(txqueue_head == ENC28J60_TXQUEUE_LENGTH) {
+                    txqueue_head = 0;
+                }
+            }
         }
         // WOLIF is not enabled
         if(flags & EIR_TXERIF) {
@@ -683,6 +1224,10 @@ void enc28j60_int(void)
             /* Clear interrupt flag */
             clearcontrolbit(EIR, BANKDONTCARE, EIR_TXERIF);
         }
+        if((flags & EIR_TXIF) && txqueue_count) {
+            /* Start the next queued packet. Not before handling EIR_TXERIF, since that resets the transmit logic */
+            transmit();
+        }
         if(flags & EIR_RXERIF) {
             /* A packet was aborted because there is insufficient buffer space or the packet count is 255 */
             if(bufferfull == FALSE) {
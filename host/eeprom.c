@@ -0,0 +1,123 @@
+/*
+    Piconet RS232 ethernet interface
+
+    eeprom.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; 25AA02E48 EEPROM model.
+
+256 bytes, 16 byte pages, with the upper quarter write protected and an EUI-48 node
+address at 0xFA. A write takes 5ms, during which the WIP status bit is set.
+*/
+#include <config.h>
+#include <string.h>
+
+#define INST_READ       0x03
+#define INST_WRITE      0x02
+#define INST_WRDI       0x04
+#define INST_WREN       0x06
+#define INST_RDSR       0x05
+#define INST_WRSR       0x01
+
+#define STATUS_WIP      (1<<0)
+#define STATUS_WEL      (1<<1)
+
+#define WRITE_CYCLES    (5000UL * HOST_CYCLES_PER_US)
+
+static unsigned char memory[256];
+static const char *imagefile;
+
+static unsigned char instruction;
+static unsigned char address;
+static unsigned char count;                 // Bytes seen since chip select
+static bool writeenabled;
+static bool written;
+static unsigned long long busy_until;
+
+void host_eeprom_init(const char *filename)
+{
+    static const unsigned char eui48[6] = { 0x00, 0x04, 0xA3, 0x12, 0x34, 0x56 };
+    FILE *f;
+
+    memset(memory, 0xFF, sizeof(memory));
+    memcpy(&memory[0xFA], eui48, sizeof(eui48));
+
+    imagefile = filename;
+    if(imagefile && (f = fopen(imagefile, "rb"))) {
+        if(fread(memory, 1, 0xC0, f) != 0xC0) {
+            fprintf(stderr, "%s: short EEPROM image\n", imagefile);
+        }
+        fclose(f);
+    }
+}
+
+void host_eeprom_program(const unsigned char address, const unsigned char *data, const unsigned char length)
+/*!
+  Preload memory, as if programmed before power-on
+*/
+{
+    memcpy(&memory[address], data, length);
+}
+
+void host_eeprom_select(const unsigned char selected)
+{
+    FILE *f;
+
+    if(!selected && written) {
+        /* Deselect starts the write cycle */
+        written = FALSE;
+        writeenabled = FALSE;
+        busy_until = host_time + WRITE_CYCLES;
+        if(imagefile && (f = fopen(imagefile, "wb"))) {
+            fwrite(memory, 1, sizeof(memory), f);
+            fclose(f);
+        }
+    }
+    count = 0;
+}
+
+unsigned char host_eeprom_transfer(const unsigned char data)
+{
+    unsigned char out = 0xFF;
+    bool busy = host_time < busy_until;
+
+    if(count == 0) {
+        instruction = data;
+        if(!busy && instruction == INST_WREN) {
+            writeenabled = TRUE;
+        }
+        else if(!busy && instruction == INST_WRDI) {
+            writeenabled = FALSE;
+        }
+    }
+    else if(instruction == INST_RDSR) {
+        out = (busy ? STATUS_WIP : 0) | (writeenabled ? STATUS_WEL : 0);
+    }
+    else if(busy) {
+        /* Only the status register can be read during a write cycle */
+    }
+    else if(count == 1 && (instruction == INST_READ || instruction == INST_WRITE)) {
+        address = data;
+    }
+    else if(instruction == INST_READ) {
+        out = memory[address++];
+    }
+    else if(instruction == INST_WRITE && writeenabled) {
+        /* Writes wrap within a page; the upper quarter is write protected */
+        if(address < 0xC0) {
+            memory[address] = data;
+            written = TRUE;
+        }
+        address = (address & 0xF0) | ((address + 1) & 0x0F);
+    }
+    count++;
+
+    return out;
+}
@@ -0,0 +1,801 @@
+/*
+    Piconet RS232 ethernet interface
+
+    enc28j60.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; ENC28J60 model.
+
+Implements the SPI command set (RCR, WCR, RBM, WBM, BFS, BFC and SC), the four register
+banks with their common registers, the PHY registers behind the MII interface, the 8 KB
+buffer memory with the receive ring, EPKTCNT, the receive filters, transmission with the
+status vector written after the packet, the DMA copy/checksum engine and the INT pin.
+Frames come from and go to net.c, at 10 Mbit/s.
+
+ESTAT.RXBUSY is set while a frame comes in over the wire. Of the errata, only the DMA
+checksum is modelled: it comes out wrong when a frame is written to the receive buffer
+while it runs.
+
+Not modelled: collisions, pause frames, Wake-on-LAN, the built-in self test and the other
+errata.
+*/
+#include <config.h>
+#include <string.h>
+#include "enc28j60_registers.h"
+
+/* SPI opcodes, upper 3 bits */
+#define OP_RCR          0
+#define OP_RBM          1
+#define OP_WCR          2
+#define OP_WBM          3
+#define OP_BFS          4
+#define OP_BFC          5
+#define OP_SC           7
+
+/* Register file; the common registers (0x1B-0x1F) are kept in bank 0 */
+static unsigned char regs[4][32];
+static unsigned short phy[32];
+static unsigned char memory[8192];
+
+#define ETH(address)            regs[0][address]
+#define BANK                    (ETH(ECON1) & (ECON1_BSEL1 | ECON1_BSEL0))
+#define POINTER(bank, address)  ((unsigned short)((regs[bank][address] | (regs[bank][(address)+1] << 8)) & 0x1FFF))
+
+/* SPI command in progress */
+static bool selected;
+static bool inreset;
+static unsigned char command;
+static unsigned short count;
+
+/* Receive write pointer; internal, readable through ERXWRPT */
+static unsigned short rxwritepointer;
+
+/* Events; 0 when nothing is pending */
+static unsigned long long tx_done;
+static unsigned long long dma_done;
+static unsigned long long mii_done;
+static unsigned long long link_at;
+static bool mii_read;                       // MII operation in progress is a read
+static bool dma_spoiled;                    // A frame was received during the DMA operation
+
+static bool intpin;                         // INT asserted (low)
+static bool linkup;
+
+/* Statistics */
+static unsigned long long stat_commands[8], stat_bytes[8];
+static unsigned long stat_rx_frames, stat_rx_overflow, stat_rx_filtered, stat_tx_frames, stat_dma;
+
+/* 10 Mbit/s; 100 ns per bit */
+#define WIRE_CYCLES(bytes)      ((unsigned long long)(bytes) * 8 * HOST_CYCLES_PER_US / 10)
+/* Preamble and start-of-frame delimiter, frame check sequence, inter-packet gap */
+#define WIRE_OVERHEAD           (8 + 4 + 12)
+/* MII operations take 10.24 us */
+#define MII_CYCLES              (HOST_CYCLES_PER_US * 1024 / 100)
+/* DMA runs from the 25 MHz main clock, taking two clocks per byte */
+#define DMA_CYCLES(bytes)       ((unsigned long long)(bytes) * 2 * HOST_CYCLES_PER_US / 25 + 1)
+/* The link comes up this long after a reset, when a cable is connected */
+#define LINK_CYCLES             (50000ULL * HOST_CYCLES_PER_US)
+
+static unsigned long crc32(const unsigned char *data, unsigned short length)
+{
+    unsigned long crc = 0xFFFFFFFF;
+    unsigned char i;
+
+    while(length--) {
+        crc ^= *data++;
+        for(i=0;i<8;i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void update_int(void)
+/*!
+  Drive the INT pin and PKTIF; a falling edge on INT sets INT1IF, as INT1 is setup for the falling edge
+*/
+{
+    bool asserted;
+
+    if(regs[1][EPKTCNT]) {
+        ETH(EIR) |= EIR_PKTIF;
+    }
+    else {
+        ETH(EIR) &= ~EIR_PKTIF;
+    }
+
+    /* ESTAT.INT shows a pending interrupt, INTIE only gates the pin */
+    if(ETH(EIE) & ETH(EIR) & (EIR_PKTIF | EIR_DMAIF | EIR_LINKIF | EIR_TXIF | EIR_TXERIF | EIR_RXERIF)) {
+        ETH(ESTAT) |= ESTAT_INT;
+    }
+    else {
+        ETH(ESTAT) &= ~ESTAT_INT;
+    }
+    asserted = (ETH(EIE) & EIE_INTIE) && (ETH(ESTAT) & ESTAT_INT);
+    if(asserted && !intpin && !INTCON2bits.INTEDG1) {
+        INTCON3bits.INT1IF = 1;
+    }
+    if(!asserted && intpin && INTCON2bits.INTEDG1) {
+        INTCON3bits.INT1IF = 1;
+    }
+    intpin = asserted;
+}
+
+static void reset(void)
+/*!
+  Power-on, reset pin or SC command; buffer memory keeps its contents
+*/
+{
+    memset(regs, 0, sizeof(regs));
+    memset(phy, 0, sizeof(phy));
+
+    ETH(ERDPTL) = 0xFA;
+    ETH(ERDPTH) = 0x05;
+    ETH(ERXSTL) = 0xFA;
+    ETH(ERXSTH) = 0x05;
+    ETH(ERXNDL) = 0xFF;
+    ETH(ERXNDH) = 0x1F;
+    ETH(ERXRDPTL) = 0xFA;
+    ETH(ERXRDPTH) = 0x05;
+    ETH(ESTAT) = ESTAT_CLKRDY;
+    ETH(ECON2) = ECON2_AUTOINC;
+    regs[1][ERXFCON] = ERXFCON_UCEN | ERXFCON_CRCEN | ERXFCON_BCEN;
+    regs[1][EPMCSL] = 0x00;
+    regs[1][EPMCSH] = 0x00;
+    regs[2][MACON2] = MACON2_MARST;
+    regs[2][MACON3] = 0x00;
+    regs[2][MAMXFLL] = 0xEE;
+    regs[2][MAMXFLH] = 0x05;
+    regs[3][EREVID] = 0x06;                 // Silicon revision B7
+
+    phy[PHID1] = 0x0083;
+    phy[PHID2] = 0x1400;
+
+    rxwritepointer = 0x05FA;
+    tx_done = 0;
+    dma_done = 0;
+    mii_done = 0;
+    linkup = FALSE;
+    link_at = host_time + LINK_CYCLES;
+
+    update_int();
+}
+
+static unsigned short ring_next(unsigned short pointer)
+/*!
+  Next address; within the receive ring, reading or writing past ERXND wraps to ERXST
+*/
+{
+    if(pointer == POINTER(0, ERXNDL)) {
+        return POINTER(0, ERXSTL);
+    }
+    return (pointer + 1) & 0x1FFF;
+}
+
+static unsigned short rx_free(void)
+/*!
+  Free space in the receive ring
+*/
+{
+    unsigned short start = POINTER(0, ERXSTL);
+    unsigned short end = POINTER(0, ERXNDL);
+    unsigned short readpointer = POINTER(0, ERXRDPTL);
+
+    if(rxwritepointer >= readpointer) {
+        return (end - start) - (rxwritepointer - readpointer);
+    }
+    return readpointer - rxwritepointer - 1;
+}
+
+static void phy_write(const unsigned char address, const unsigned short value)
+{
+    switch(address) {
+        case PHCON1:
+            phy[PHCON1] = value & ~PHCON1_PRST;
+            break;
+        case PHSTAT1:
+        case PHSTAT2:
+        case PHIR:
+        case PHID1:
+        case PHID2:
+            /* Read only */
+            break;
+        default:
+            phy[address] = value;
+            break;
+    }
+}
+
+static unsigned short phy_read(const unsigned char address)
+{
+    unsigned short value;
+
+    switch(address) {
+        case PHSTAT1:
+            value = linkup ? PHSTAT1_LLSTAT : 0;
+            break;
+        case PHSTAT2:
+            value = (linkup ? PHSTAT2_LSTAT : 0) | ((phy[PHCON1] & PHCON1_PDPXMD) ? PHSTAT2_DPXSTAT : 0) | (tx_done ? PHSTAT2_TXSTAT : 0);
+            break;
+        case PHIR:
+            /* Reading clears the interrupt flags, and with that LINKIF */
+            value = phy[PHIR];
+            phy[PHIR] = 0;
+            ETH(EIR) &= ~EIR_LINKIF;
+            break;
+        default:
+            value = phy[address];
+            break;
+    }
+    return value;
+}
+
+static void transmit_start(void)
+{
+    unsigned short start = POINTER(0, ETXSTL);
+    unsigned short end = POINTER(0, ETXNDL);
+    unsigned short length = ((end - start) & 0x1FFF) + 4;
+
+    if(length < 64) {
+        length = 64;
+    }
+    tx_done = host_time + WIRE_CYCLES(length + WIRE_OVERHEAD - 4);
+    if(!tx_done) {
+        tx_done = 1;
+    }
+}
+
+static void transmit_done(void)
+/*!
+  Put the frame on the wire and write the status vector right after it
+*/
+{
+    static unsigned char frame[8192];
+    unsigned short start = POINTER(0, ETXSTL);
+    unsigned short end = POINTER(0, ETXNDL);
+    unsigned short length = 0;
+    unsigned short pointer;
+    unsigned short status;
+    unsigned char control;
+
+    control = memory[start];
+    pointer = (start + 1) & 0x1FFF;
+    while(pointer != ((end + 1) & 0x1FFF)) {
+        frame[length++] = memory[pointer];
+        pointer = (pointer + 1) & 0x1FFF;
+    }
+    /* Padding, as per the per-packet control byte or MACON3; only 60 byte padding is done here */
+    if((control & 0x01 ? control : regs[2][MACON3]) & MACON3_PADCFG0) {
+        while(length < 60) {
+            frame[length++] = 0;
+        }
+    }
+
+    host_net_transmit(frame, length);
+    stat_tx_frames++;
+
+    status = TXSTATUS1_DONE;
+    if(frame[0] == 0xFF && frame[1] == 0xFF && frame[2] == 0xFF) {
+        status |= TXSTATUS1_BROADCAST;
+    }
+    else if(frame[0] & 0x01) {
+        status |= TXSTATUS1_MULTICAST;
+    }
+    pointer = (end + 1) & 0x1FFF;
+    memory[pointer] = (length + 4) & 0xFF;                  pointer = (pointer + 1) & 0x1FFF;
+    memory[pointer] = (length + 4) >> 8;                    pointer = (pointer + 1) & 0x1FFF;
+    memory[pointer] = status & 0xFF;                        pointer = (pointer + 1) & 0x1FFF;
+    memory[pointer] = status >> 8;                          pointer = (pointer + 1) & 0x1FFF;
+    memory[pointer] = (length + 4 + 8) & 0xFF;              pointer = (pointer + 1) & 0x1FFF;
+    memory[pointer] = (length + 4 + 8) >> 8;                pointer = (pointer + 1) & 0x1FFF;
+    memory[pointer] = 0;
+
+    tx_done = 0;
+    ETH(ECON1) &= ~ECON1_TXRTS;
+    ETH(EIR) |= EIR_TXIF;
+}
+
+static void dma_start(void)
+{
+    unsigned short start = POINTER(0, EDMASTL);
+    unsigned short end = POINTER(0, EDMANDL);
+    unsigned short length = 1;
+    unsigned short pointer = start;
+
+    while(pointer != end && length < 8192) {
+        pointer = ring_next(pointer);
+        length++;
+    }
+    dma_done = host_time + DMA_CYCLES(length);
+    dma_spoiled = FALSE;
+    stat_dma++;
+}
+
+static void dma_done_event(void)
+/*!
+  Checksum or copy from EDMAST up to and including EDMAND, wrapping around in the receive ring
+*/
+{
+    unsigned short pointer = POINTER(0, EDMASTL);
+    unsigned short end = POINTER(0, EDMANDL);
+    unsigned short destination = POINTER(0, EDMADSTL);
+    unsigned long sum = 0;
+    bool odd = FALSE;
+
+    while(1) {
+        if(ETH(ECON1) & ECON1_CSUMEN) {
+            sum += odd ? memory[pointer] : (memory[pointer] << 8);
+            odd = !odd;
+        }
+        else {
+            memory[destination] = memory[pointer];
+            destination = ring_next(destination);
+        }
+        if(pointer == end) {
+            break;
+        }
+        pointer = ring_next(pointer);
+    }
+    if(ETH(ECON1) & ECON1_CSUMEN) {
+        while(sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        sum = ~sum & 0xFFFF;
+        if(dma_spoiled) {
+            /* Erreta rev. B7; any wrong value will do */
+            sum ^= 0x0100;
+        }
+        ETH(EDMACSH) = sum >> 8;
+        ETH(EDMACSL) = sum & 0xFF;
+    }
+
+    dma_done = 0;
+    ETH(ECON1) &= ~ECON1_DMAST;
+    ETH(EIR) |= EIR_DMAIF;
+}
+
+static unsigned char read_register(const unsigned char address)
+{
+    unsigned char bank = address >= EIE ? 0 : BANK;
+
+    if(bank == 0 && (address == ERXWRPTL || address == ERXWRPTH)) {
+        return address == ERXWRPTL ? rxwritepointer & 0xFF : rxwritepointer >> 8;
+    }
+    if(bank == 2 && (address == MIRDL || address == MIRDH) && mii_done) {
+        /* Not valid yet */
+        return 0;
+    }
+    if(address == ESTAT) {
+        return (ETH(ESTAT) & ~ESTAT_RXBUSY) |
+               (linkup && (ETH(ECON1) & ECON1_RXEN) && host_net_receiving() ? ESTAT_RXBUSY : 0);
+    }
+    return regs[bank][address];
+}
+
+static void write_register(const unsigned char address, unsigned char value)
+{
+    unsigned char bank = address >= EIE ? 0 : BANK;
+    unsigned char old = regs[bank][address];
+
+    switch(((bank + 1) << 8) | address) {
+        /* Common registers */
+        case 0x100 | EIR:
+            /* PKTIF is read-only */
+            regs[0][EIR] = (value & ~EIR_PKTIF) | (old & EIR_PKTIF);
+            break;
+        case 0x100 | ESTAT:
+            regs[0][ESTAT] = (old & (ESTAT_INT | ESTAT_CLKRDY | ESTAT_RXBUSY)) | (value & ~(ESTAT_INT | ESTAT_CLKRDY | ESTAT_RXBUSY));
+            break;
+        case 0x100 | ECON2:
+            if(value & ECON2_PKTDEC) {
+                if(regs[1][EPKTCNT]) {
+                    regs[1][EPKTCNT]--;
+                }
+                value &= ~ECON2_PKTDEC;
+            }
+            regs[0][ECON2] = value;
+            break;
+        case 0x100 | ECON1:
+            if(value & ECON1_TXRST) {
+                /* Transmit logic held in reset */
+                value &= ~ECON1_TXRTS;
+            }
+            regs[0][ECON1] = value;
+            if((value & ECON1_TXRTS) && !(old & ECON1_TXRTS)) {
+                transmit_start();
+            }
+            else if(!(value & ECON1_TXRTS)) {
+                /* Clearing TXRTS aborts a transmission in progress */
+                tx_done = 0;
+            }
+            if((value & ECON1_DMAST) && !(old & ECON1_DMAST)) {
+                dma_start();
+            }
+            else if(!(value & ECON1_DMAST)) {
+                /* Clearing DMAST aborts a DMA operation in progress */
+                dma_done = 0;
+            }
+            break;
+
+        /* Bank 0 */
+        case 0x100 | ERXSTL:
+        case 0x100 | ERXSTH:
+            /* Setting the start of the receive ring moves the write pointer there */
+            regs[0][address] = value;
+            rxwritepointer = POINTER(0, ERXSTL);
+            break;
+        case 0x100 | ERXWRPTL:
+        case 0x100 | ERXWRPTH:
+            break;
+
+        /* Bank 1 */
+        case 0x200 | EPKTCNT:
+            break;
+
+        /* Bank 2 */
+        case 0x300 | MICMD:
+            regs[2][MICMD] = value;
+            if((value & MICMD_MIIRD) && !(old & MICMD_MIIRD)) {
+                mii_done = host_time + MII_CYCLES;
+                mii_read = TRUE;
+                regs[3][MISTAT] |= MISTAT_BUSY;
+            }
+            break;
+        case 0x300 | MIWRH:
+            regs[2][MIWRH] = value;
+            phy_write(regs[2][MIREGADR] & 0x1F, regs[2][MIWRL] | (value << 8));
+            mii_done = host_time + MII_CYCLES;
+            mii_read = FALSE;
+            regs[3][MISTAT] |= MISTAT_BUSY;
+            break;
+        case 0x300 | MIRDL:
+        case 0x300 | MIRDH:
+            break;
+
+        /* Bank 3 */
+        case 0x400 | EREVID:
+        case 0x400 | MISTAT:
+            break;
+
+        default:
+            if((address & REGISTERMASK) != 0x1A) {
+                regs[bank][address] = value;
+            }
+            break;
+    }
+    update_int();
+}
+
+static bool mac_or_mii(const unsigned char address)
+/*!
+  MAC and MII registers shift out a dummy byte before the data
+*/
+{
+    unsigned char bank = BANK;
+
+    if(address >= EIE) {
+        return FALSE;
+    }
+    return (bank == 2) || (bank == 3 && (address <= MAADR4 || address == MISTAT));
+}
+
+void host_enc28j60_select(const unsigned char cs)
+{
+    selected = cs;
+    count = 0;
+}
+
+void host_enc28j60_reset(const unsigned char asserted)
+{
+    if(asserted && !inreset) {
+        inreset = TRUE;
+    }
+    else if(!asserted && inreset) {
+        inreset = FALSE;
+        reset();
+    }
+}
+
+unsigned char host_enc28j60_transfer(const unsigned char data)
+{
+    unsigned char out = 0;
+    unsigned short pointer;
+
+    if(!selected || inreset) {
+        return 0;
+    }
+
+    if(count == 0) {
+        command = data;
+        stat_commands[command >> 5]++;
+        if(command == 0xFF) {
+            reset();
+        }
+    }
+    else {
+        switch(command >> 5) {
+            case OP_RCR:
+                if(mac_or_mii(command & 0x1F) && count == 1) {
+                    out = 0;
+                }
+                else {
+                    out = read_register(command & 0x1F);
+                }
+                break;
+            case OP_WCR:
+                if(count == 1) {
+                    write_register(command & 0x1F, data);
+                }
+                break;
+            case OP_BFS:
+            case OP_BFC:
+                /* ETH registers only */
+                if(count == 1 && ((command & 0x1F) >= EIE || BANK == 0 || BANK == 1)) {
+                    if((command >> 5) == OP_BFS) {
+                        write_register(command & 0x1F, read_register(command & 0x1F) | data);
+                    }
+                    else {
+                        write_register(command & 0x1F, read_register(command & 0x1F) & ~data);
+                    }
+                }
+                break;
+            case OP_RBM:
+                pointer = POINTER(0, ERDPTL);
+                out = memory[pointer];
+                if(ETH(ECON2) & ECON2_AUTOINC) {
+                    pointer = ring_next(pointer);
+                    ETH(ERDPTL) = pointer & 0xFF;
+                    ETH(ERDPTH) = pointer >> 8;
+                }
+                break;
+            case OP_WBM:
+                pointer = POINTER(0, EWRPTL);
+                memory[pointer] = data;
+                if(ETH(ECON2) & ECON2_AUTOINC) {
+                    pointer = (pointer + 1) & 0x1FFF;
+                    ETH(EWRPTL) = pointer & 0xFF;
+                    ETH(EWRPTH) = pointer >> 8;
+                }
+                break;
+        }
+    }
+    stat_bytes[command >> 5]++;
+    count++;
+
+    return out;
+}
+
+static bool filter(const unsigned char *frame, const unsigned short length)
+/*!
+  Receive filters (ERXFCON). In AND mode the three destination address filters are
+  taken together as one filter.
+*/
+{
+    unsigned char erxfcon = regs[1][ERXFCON];
+    unsigned char mac[6];
+    bool and = (erxfcon & ERXFCON_ANDOR) != 0;
+    bool addressfilter, addressmatch = FALSE;
+    bool patternmatch = FALSE, hashmatch = FALSE;
+    unsigned short offset, i, sum;
+    unsigned long crc;
+
+    mac[0] = regs[3][MAADR5];
+    mac[1] = regs[3][MAADR4];
+    mac[2] = regs[3][MAADR3];
+    mac[3] = regs[3][MAADR2];
+    mac[4] = regs[3][MAADR1];
+    mac[5] = regs[3][MAADR0];
+
+    addressfilter = (erxfcon & (ERXFCON_UCEN | ERXFCON_MCEN | ERXFCON_BCEN)) != 0;
+    if((erxfcon & ERXFCON_UCEN) && memcmp(frame, mac, 6) == 0) {
+        addressmatch = TRUE;
+    }
+    if((erxfcon & ERXFCON_BCEN) && memcmp(frame, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) == 0) {
+        addressmatch = TRUE;
+    }
+    if((erxfcon & ERXFCON_MCEN) && (frame[0] & 0x01)) {
+        addressmatch = TRUE;
+    }
+
+    if(erxfcon & ERXFCON_PMEN) {
+        /* Checksum over the bytes selected by EPMM, in a 64 byte window at EPMO */
+        offset = regs[1][EPMOL] | (regs[1][EPMOH] << 8);
+        sum = 0;
+        {
+            unsigned long s = 0;
+            bool odd = FALSE;
+            for(i=0;i<64;i++) {
+                if(regs[1][EPMM0 + i/8] & (1 << (i%8))) {
+                    unsigned char b = (offset + i < length) ? frame[offset + i] : 0;
+                    if(offset + i >= length) {
+                        break;
+                    }
+                    s += odd ? b : (b << 8);
+                    odd = !odd;
+                }
+            }
+            while(s >> 16) {
+                s = (s & 0xFFFF) + (s >> 16);
+            }
+            sum = ~s & 0xFFFF;
+        }
+        patternmatch = sum == (regs[1][EPMCSL] | (regs[1][EPMCSH] << 8));
+    }
+
+    if(erxfcon & ERXFCON_HTEN) {
+        crc = crc32(frame, 6);
+        i = (crc >> 23) & 0x3F;
+        hashmatch = (regs[1][EHT0 + i/8] & (1 << (i%8))) != 0;
+    }
+
+    if(and) {
+        if(addressfilter && !addressmatch) {
+            return FALSE;
+        }
+        if((erxfcon & ERXFCON_PMEN) && !patternmatch) {
+            return FALSE;
+        }
+        if((erxfcon & ERXFCON_HTEN) && !hashmatch) {
+            return FALSE;
+        }
+        return TRUE;
+    }
+    if(!(erxfcon & (ERXFCON_UCEN | ERXFCON_MCEN | ERXFCON_BCEN | ERXFCON_PMEN | ERXFCON_HTEN | ERXFCON_MPEN))) {
+        /* All filters disabled */
+        return TRUE;
+    }
+    return addressmatch || patternmatch || hashmatch;
+}
+
+unsigned char host_enc28j60_receive(const unsigned char *frame, unsigned short length)
+/*!
+  A frame (without FCS) came in from the wire. Returns FALSE when it was dropped
+*/
+{
+    unsigned char header[6];
+    unsigned char fcs[4];
+    unsigned short stored, next, pointer, i;
+    unsigned short status;
+    unsigned long crc;
+
+    if(!linkup || inreset || !(ETH(ECON1) & ECON1_RXEN) || !(regs[2][MACON1] & MACON1_MARXEN)) {
+        return FALSE;
+    }
+    if(!filter(frame, length)) {
+        stat_rx_filtered++;
+        return FALSE;
+    }
+
+    stored = length + 4;
+    if(regs[1][EPKTCNT] == 255 || rx_free() < 6 + stored + 1) {
+        ETH(EIR) |= EIR_RXERIF;
+        stat_rx_overflow++;
+        update_int();
+        return FALSE;
+    }
+
+    crc = crc32(frame, length);
+    fcs[0] = crc & 0xFF;
+    fcs[1] = (crc >> 8) & 0xFF;
+    fcs[2] = (crc >> 16) & 0xFF;
+    fcs[3] = (crc >> 24) & 0xFF;
+
+    /* Next packet starts at an even address */
+    next = rxwritepointer;
+    for(i=0;i<6 + stored + ((6 + stored) & 1);i++) {
+        next = ring_next(next);
+    }
+
+    status = RXSTATUS_OK;
+    if(memcmp(frame, "\xFF\xFF\xFF\xFF\xFF\xFF", 6) == 0) {
+        status |= RXSTATUS_BROADCAST;
+    }
+    else if(frame[0] & 0x01) {
+        status |= RXSTATUS_MULTICAST;
+    }
+    header[0] = next & 0xFF;
+    header[1] = next >> 8;
+    header[2] = stored & 0xFF;
+    header[3] = stored >> 8;
+    header[4] = status & 0xFF;
+    header[5] = status >> 8;
+
+    pointer = rxwritepointer;
+    for(i=0;i<6;i++) {
+        memory[pointer] = header[i];
+        pointer = ring_next(pointer);
+    }
+    for(i=0;i<length;i++) {
+        memory[pointer] = frame[i];
+        pointer = ring_next(pointer);
+    }
+    for(i=0;i<4;i++) {
+        memory[pointer] = fcs[i];
+        pointer = ring_next(pointer);
+    }
+    rxwritepointer = next;
+
+    regs[1][EPKTCNT]++;
+    stat_rx_frames++;
+    if(dma_done && (ETH(ECON1) & ECON1_CSUMEN)) {
+        dma_spoiled = TRUE;
+    }
+    update_int();
+
+    return TRUE;
+}
+
+unsigned char host_enc28j60_linkup(void)
+{
+    return linkup;
+}
+
+void host_enc28j60_update(void)
+/*!
+  Called whenever time advances
+*/
+{
+    if(inreset) {
+        return;
+    }
+    if(tx_done && host_time >= tx_done) {
+        transmit_done();
+        update_int();
+    }
+    if(dma_done && host_time >= dma_done) {
+        dma_done_event();
+        update_int();
+    }
+    if(mii_done && host_time >= mii_done) {
+        mii_done = 0;
+        regs[3][MISTAT] &= ~MISTAT_BUSY;
+        if(mii_read) {
+            /* Done even when MIIRD was cleared before the read completed */
+            unsigned short value = phy_read(regs[2][MIREGADR] & 0x1F);
+            regs[2][MIRDL] = value & 0xFF;
+            regs[2][MIRDH] = value >> 8;
+        }
+        update_int();
+    }
+    if(link_at && host_time >= link_at) {
+        link_at = 0;
+        linkup = TRUE;
+        phy[PHIR] |= (1<<4) | (1<<2);       // PLNKIF, PGIF
+        if((phy[PHIE] & PHIE_PGEIE) && (phy[PHIE] & PHIE_PLNKIE)) {
+            ETH(EIR) |= EIR_LINKIF;
+        }
+        update_int();
+    }
+}
+
+void host_enc28j60_init(void)
+/*!
+  Power-on
+*/
+{
+    inreset = FALSE;
+    reset();
+}
+
+void host_enc28j60_report(FILE *f)
+{
+    static const char *names[8] = { "RCR", "RBM", "WCR", "WBM", "BFS", "BFC", "---", "SC" };
+    unsigned char i;
+
+    fprintf(f, "ENC28J60: %lu frames received, %lu filtered, %lu dropped (buffer full), %lu transmitted, %lu DMA operations\n",
+            stat_rx_frames, stat_rx_filtered, stat_rx_overflow, stat_tx_frames, stat_dma);
+    fprintf(f, "ENC28J60 SPI:");
+    for(i=0;i<8;i++) {
+        if(stat_commands[i]) {
+            fprintf(f, " %s %llu/%llu", names[i], stat_commands[i], stat_bytes[i]);
+        }
+    }
+    fprintf(f, " (commands/bytes)\n");
+}
@@ -0,0 +1,506 @@
+/*
+    Piconet RS232 ethernet interface
+
+    host.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; startpoint, virtual time, timers and interrupt dispatching
+*/
+#define _GNU_SOURCE         // fopencookie()
+#include <config.h>
+#include "settings.h"
+#include "ssp.h"
+#include "seriald/seriald.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Firmware entry points */
+void piconet_main(void);
+void isr_high(void);
+void isr_low(void);
+void putch(char c);
+
+unsigned long long host_time;
+
+static unsigned long long host_end;         // Stop when host_time reaches this, 0 to run forever
+static unsigned long long host_loops;       // Passes through the main loop
+static unsigned long timer1_remainder;      // Instruction cycles not yet counted by timer1
+static unsigned long timer3_remainder;      // ..and by timer3
+static unsigned long long rtc_next;         // Next RTC alarm
+static bool in_isr_high, in_isr_low;
+static bool peer;                           // Built-in TCP client enabled
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  -t seconds   stop after this much virtual time (default: run forever)\n");
+    fprintf(stderr, "  -i file      feed this file to the UART receiver ('-' is stdin, default: nothing)\n");
+    fprintf(stderr, "  -g           hold the UART receiver input until seriald has the built-in client or peer (with -p)\n");
+    fprintf(stderr, "  -o file      write UART transmitter output here (default: stdout)\n");
+    fprintf(stderr, "  -e file      EEPROM image, loaded at start and written back on changes\n");
+    fprintf(stderr, "  -n ip:port   program settings for a fixed address and a seriald TCP port\n");
+    fprintf(stderr, "  -b baudrate  program settings for this serial baudrate (with -n)\n");
+    fprintf(stderr, "  -f hex       program settings for records ending with this 1-4 byte delimiter (with -n)\n");
+    fprintf(stderr, "  -u peer|any  program settings for seriald UDP, sending to the built-in peer or to the last sender (with -n)\n");
+    fprintf(stderr, "  -c h|s|e     program settings for RTS/CTS, XON/XOFF or escaped XON/XOFF flowcontrol (with -n)\n");
+    fprintf(stderr, "  -a baudrate  UART receiver input comes at this baudrate instead, and settings are\n");
+    fprintf(stderr, "               programmed for auto-baud detection (with -n); start the input with 'U's\n");
+    fprintf(stderr, "  -r file      inject frames from this pcap file, once the link is up\n");
+    fprintf(stderr, "  -w file      write frames sent by the ENC28J60 to this pcap file\n");
+    fprintf(stderr, "  -x command   run command with a packet socket on its stdin/stdout, one frame per message\n");
+    fprintf(stderr, "  -l ms        delay frames towards the ENC28J60 this long, for a round trip time\n");
+    fprintf(stderr, "  -m n         lose every n'th frame sent by the ENC28J60\n");
+    fprintf(stderr, "  -p           connect to seriald with the built-in TCP client, or UDP peer with -u (needs -n)\n");
+    fprintf(stderr, "  -s file      TCP client or UDP peer sends this file to seriald\n");
+    fprintf(stderr, "  -d file      TCP client or UDP peer writes data received from seriald here\n");
+}
+
+static void program_settings(const unsigned char ip[4], const unsigned short port, const unsigned long baudrate,
+                             const unsigned char *delimiter, const unsigned char delimiterlength,
+                             const unsigned char udp, const unsigned char *peer, const unsigned short peerport,
+                             const unsigned char flowcontrol, const unsigned char autobaud)
+/*!
+  Fill the EEPROM with settings, as settings_store() would. With 'udp' set, datagrams go to
+  'peer', or to the last sender when that's NULL. 'flowcontrol' holds the serial_mode bits,
+  'autobaud' goes to serial_autobaud
+*/
+{
+    settings_t s;
+    unsigned char checksum = 0;
+    unsigned char i;
+
+    settings_default();
+    s = settings;
+    memcpy(s.network_ip, ip, 4);
+    s.network_mask[0] = 255;
+    s.network_mask[1] = 255;
+    s.network_mask[2] = 255;
+    memcpy(s.network_gw, ip, 4);
+    s.network_gw[3] = 1;
+    s.network_port = port;
+    if(udp) {
+        s.network_mode = 0;
+        if(peer) {
+            memcpy(s.network_peer, peer, 4);
+            s.network_peerport = peerport;
+        }
+    }
+    else {
+        s.network_mode = NETWORK_MODE_TCP;
+    }
+    s.serial_baudrate = SERIAL_BAUDRATE(baudrate);
+    memcpy(s.serial_delimiter, delimiter, delimiterlength);
+    s.serial_delimiterlength = delimiterlength;
+    s.serial_mode &= ~(SERIAL_MODE_FLOWCONTROL | SERIAL_MODE_ESCAPE);
+    s.serial_mode |= flowcontrol;
+    s.serial_autobaud = autobaud;
+
+    for(i=0;i<sizeof(s);i++) {
+        checksum += ((unsigned char *)&s)[i];
+    }
+    host_eeprom_program(0, (unsigned char *)&s, sizeof(s));
+    host_eeprom_program(sizeof(s), &checksum, 1);
+}
+
+static void report(void)
+/*!
+  Statistics, printed on exit
+*/
+{
+    extern seriald_statistics_t seriald_statistics;
+
+    fprintf(stderr, "\n--- %.3f s virtual time, %llu main loop passes\n", (double)host_time / (HOST_CYCLES_PER_US * 1000000.0), host_loops);
+    host_uart_report(stderr);
+    fprintf(stderr, "seriald: %u bytes dropped by the UART, %u for lack of room, %u received while UART2 was behind\n",
+            seriald_statistics.uart_dropped, seriald_statistics.net_dropped, seriald_statistics.serial_dropped);
+    host_spi_report(stderr);
+    #if SSP_PROFILE
+    {
+        static const char *classes[SSP_CLASSES] = { "ENC28J60 registers", "ENC28J60 buffer", "EEPROM", "SD card" };
+        unsigned char i;
+
+        for(i=0;i<SSP_CLASSES;i++) {
+            fprintf(stderr, "  %s: %lu bytes, %.3f ms\n", classes[i], ssp_profile[i].bytes, (double)ssp_profile[i].cycles / (HOST_CYCLES_PER_US * 1000.0));
+        }
+    }
+    #endif
+    host_enc28j60_report(stderr);
+    host_net_report(stderr);
+    if(peer) {
+        host_peer_report(stderr);
+        if(host_peer_received()) {
+            fprintf(stderr, "SSP2 bytes per payload byte delivered: %.2f\n", (double)host_spi_bytes(2) / host_peer_received());
+        }
+    }
+}
+
+static ssize_t console_write(void *cookie, const char *buffer, size_t size)
+/*!
+  printf() output goes through putch(), and with that out the UART, just like on the PIC
+*/
+{
+    size_t i;
+
+    for(i=0;i<size;i++) {
+        putch(buffer[i]);
+    }
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    int rx_fd = -1;
+    int tx_fd = STDOUT_FILENO;
+    const char *eeprom = NULL;
+    const char *pcap_in = NULL, *pcap_out = NULL, *command = NULL;
+    int send_fd = -1, dump_fd = -1;
+    unsigned int ip[4];
+    unsigned char address[4];
+    unsigned int port = 0;
+    unsigned long baudrate = 9600;
+    unsigned long senderbaudrate = 0;
+    unsigned char delimiter[4];
+    unsigned char delimiterlength = 0;
+    unsigned long latency = 0;
+    unsigned long lose = 0;
+    unsigned char udp = FALSE, udppeer = FALSE;
+    unsigned char wait = FALSE;
+    unsigned char flowcontrol = SERIAL_MODE_FLOWCONTROL_NONE;
+    unsigned char peeraddress[4];
+    unsigned int byte;
+    unsigned char i;
+
+    while((opt = getopt(argc, argv, "t:i:go:e:n:b:a:f:u:c:r:w:x:l:m:ps:d:h")) != -1) {
+        switch(opt) {
+            case 't':
+                host_end = (unsigned long long)(atof(optarg) * HOST_CYCLES_PER_US * 1000000.0);
+                break;
+            case 'i':
+                if(strcmp(optarg, "-") == 0) {
+                    rx_fd = STDIN_FILENO;
+                }
+                else if((rx_fd = open(optarg, O_RDONLY)) < 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'g':
+                wait = TRUE;
+                break;
+            case 'o':
+                if((tx_fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'e':
+                eeprom = optarg;
+                break;
+            case 'n':
+                if(sscanf(optarg, "%u.%u.%u.%u:%u", &ip[0], &ip[1], &ip[2], &ip[3], &port) != 5 || port == 0 || port > 65535) {
+                    fprintf(stderr, "%s: expected ip:port\n", optarg);
+                    return 1;
+                }
+                for(i=0;i<4;i++) {
+                    address[i] = ip[i];
+                }
+                break;
+            case 'b':
+                baudrate = atol(optarg);
+                if(baudrate < 300 || baudrate > CCLK / 4) {
+                    fprintf(stderr, "%s: invalid baudrate\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'a':
+                senderbaudrate = atol(optarg);
+                if(senderbaudrate < 300 || senderbaudrate > CCLK / 4) {
+                    fprintf(stderr, "%s: invalid baudrate\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f':
+                if(strlen(optarg) % 2) {
+                    fprintf(stderr, "%s: expected 1-4 bytes in hex\n", optarg);
+                    return 1;
+                }
+                for(delimiterlength=0;optarg[delimiterlength*2];delimiterlength++) {
+                    if(delimiterlength == sizeof(delimiter) || sscanf(&optarg[delimiterlength*2], "%2x", &byte) != 1) {
+                        fprintf(stderr, "%s: expected 1-4 bytes in hex\n", optarg);
+                        return 1;
+                    }
+                    delimiter[delimiterlength] = byte;
+                }
+                break;
+            case 'u':
+                if(strcmp(optarg, "peer") != 0 && strcmp(optarg, "any") != 0) {
+                    fprintf(stderr, "%s: expected peer or any\n", optarg);
+                    return 1;
+                }
+                udp = TRUE;
+                udppeer = strcmp(optarg, "peer") == 0;
+                break;
+            case 'c':
+                if(strcmp(optarg, "h") == 0) {
+                    flowcontrol = SERIAL_MODE_FLOWCONTROL_RTSCTS;
+                }
+                else if(strcmp(optarg, "s") == 0) {
+                    flowcontrol = SERIAL_MODE_FLOWCONTROL_XONXOFF;
+                }
+                else if(strcmp(optarg, "e") == 0) {
+                    flowcontrol = SERIAL_MODE_FLOWCONTROL_XONXOFF | SERIAL_MODE_ESCAPE;
+                }
+                else {
+                    fprintf(stderr, "%s: expected h, s or e\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r':
+                pcap_in = optarg;
+                break;
+            case 'w':
+                pcap_out = optarg;
+                break;
+            case 'x':
+                command = optarg;
+                break;
+            case 'l':
+                latency = atol(optarg);
+                break;
+            case 'm':
+                lose = atol(optarg);
+                break;
+            case 'p':
+                peer = TRUE;
+                break;
+            case 's':
+                if((send_fd = open(optarg, O_RDONLY)) < 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'd':
+                if((dump_fd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(peer && !port) {
+        fprintf(stderr, "-p needs -n\n");
+        return 1;
+    }
+    if(wait && !peer) {
+        fprintf(stderr, "-g needs -p\n");
+        return 1;
+    }
+
+    host_eeprom_init(eeprom);
+    if(port) {
+        host_peer_address(address, peeraddress);
+        program_settings(address, port, baudrate, delimiter, delimiterlength, udp, udppeer ? peeraddress : NULL, HOST_PEER_PORT, flowcontrol,
+                         senderbaudrate ? SERIALD_AUTOBAUD_ERRORS : 0);
+    }
+    host_uart_init(rx_fd, tx_fd, (flowcontrol & SERIAL_MODE_FLOWCONTROL) == SERIAL_MODE_FLOWCONTROL_XONXOFF, (flowcontrol & SERIAL_MODE_ESCAPE) != 0, senderbaudrate, wait);
+    host_enc28j60_init();
+    host_net_init(pcap_in, pcap_out, command, peer, latency, lose);
+    if(peer) {
+        host_peer_init(address, port, udp, send_fd, dump_fd);
+    }
+    atexit(report);
+
+    stdout = fopencookie(NULL, "w", (cookie_io_functions_t){ .write = console_write });
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    /* Power-on; all outputs high, which keeps every chip select deasserted */
+    LATA = 0xFF;
+    LATB = 0xFF;
+    LATC = 0xFF;
+    PIR3bits.TX2IF = 1;
+    PIR1bits.TXIF = 1;
+    rtc_next = 60ULL * 1000000 * HOST_CYCLES_PER_US;
+
+    piconet_main();
+
+    return 0;
+}
+
+static bool timer_update(volatile unsigned char *high, volatile unsigned char *low, const unsigned long prescaler,
+                         unsigned long *remainder, const unsigned long cycles)
+/*!
+  A 16 bit timer, clocked from Fosc/4 through the prescaler. Returns TRUE when it
+  overflowed
+*/
+{
+    unsigned long value;
+
+    *remainder += cycles;
+    value = ((unsigned long)*high << 8 | *low) + *remainder / prescaler;
+    *remainder %= prescaler;
+    *high = (value >> 8) & 0xFF;
+    *low = value & 0xFF;
+
+    return value > 0xFFFF;
+}
+
+static void timer1_update(unsigned long cycles)
+/*!
+  Timer1
+*/
+{
+    if(T1CONbits.TMR1ON &&
+       timer_update(&TMR1H, &TMR1L, 1 << (T1CONbits.T1CKPS1 * 2 + T1CONbits.T1CKPS0), &timer1_remainder, cycles)) {
+        PIR1bits.TMR1IF = 1;
+    }
+}
+
+static void timer3_update(unsigned long cycles)
+/*!
+  Timer3
+*/
+{
+    if(T3CONbits.TMR3ON &&
+       timer_update(&TMR3H, &TMR3L, 1 << (T3CONbits.T3CKPS1 * 2 + T3CONbits.T3CKPS0), &timer3_remainder, cycles)) {
+        PIR2bits.TMR3IF = 1;
+    }
+}
+
+static void rtc_update(void)
+/*!
+  RTC, only the once-a-minute alarm as setup by the firmware
+*/
+{
+    if(host_time >= rtc_next) {
+        rtc_next += 60ULL * 1000000 * HOST_CYCLES_PER_US;
+        if(RTCCFGbits.RTCEN && ALRMCFGbits.ALRMEN) {
+            PIR3bits.RTCCIF = 1;
+        }
+    }
+}
+
+static bool pending_high(void)
+{
+    return PIR3bits.RC2IF && PIE3bits.RC2IE && IPR3bits.RC2IP;
+}
+
+static bool pending_low(void)
+{
+    return (INTCON3bits.INT1IF && INTCON3bits.INT1IE && !INTCON3bits.INT1IP) ||
+           (PIR1bits.TMR1IF && PIE1bits.TMR1IE && !IPR1bits.TMR1IP) ||
+           (PIR3bits.TX2IF && PIE3bits.TX2IE && !IPR3bits.TX2IP) ||
+           (PIR3bits.RTCCIF && PIE3bits.RTCCIE && !IPR3bits.RTCCIP);
+}
+
+static void interrupts(void)
+/*!
+  Run interrupt handlers for pending and enabled interrupts. The high priority
+  handler may preempt the low priority one, nothing preempts the high priority handler.
+  Like the PIC does, GIEH or GIEL is cleared while its handler runs
+*/
+{
+    if(!RCONbits.IPEN || !INTCONbits.GIEH || in_isr_high) {
+        return;
+    }
+    while(pending_high()) {
+        in_isr_high = TRUE;
+        INTCONbits.GIEH = 0;
+        host_cycles(HOST_CYCLES_ISR);
+        isr_high();
+        INTCONbits.GIEH = 1;
+        in_isr_high = FALSE;
+    }
+    if(!INTCONbits.GIEL || in_isr_low) {
+        return;
+    }
+    while(pending_low()) {
+        in_isr_low = TRUE;
+        INTCONbits.GIEL = 0;
+        host_cycles(HOST_CYCLES_ISR);
+        isr_low();
+        INTCONbits.GIEL = 1;
+        in_isr_low = FALSE;
+    }
+}
+
+void host_cycles(unsigned long cycles)
+/*!
+  Let time pass. Done in small steps, so timer and UART events are seen at
+  about the right moment even during long delays
+*/
+{
+    unsigned long step;
+
+    while(cycles) {
+        step = cycles > 64 ? 64 : cycles;
+        cycles -= step;
+
+        host_time += step;
+        timer1_update(step);
+        timer3_update(step);
+        rtc_update();
+        host_uart_update();
+        host_enc28j60_update();
+        host_net_update();
+        interrupts();
+
+        if(host_end && host_time >= host_end) {
+            exit(0);
+        }
+    }
+}
+
+void host_mainloop(void)
+/*!
+  Called once per pass through the main loop, where the firmware clears the watchdog
+*/
+{
+    host_loops++;
+    host_cycles(HOST_CYCLES_MAINLOOP);
+}
+
+void host_reset(void)
+/*!
+  The firmware requested a reset; we just stop
+*/
+{
+    fprintf(stderr, "\n--- reset requested\n");
+    exit(2);
+}
+
+void host_pinchange(void)
+/*!
+  One of the chip select or reset lines was changed
+*/
+{
+    static unsigned char eeprom_cs = 1;
+    static unsigned char enc28j60_cs = 1;
+    static unsigned char enc28j60_reset = 1;
+
+    if(LATAbits.LATA6 != eeprom_cs) {
+        eeprom_cs = LATAbits.LATA6;
+        host_eeprom_select(!eeprom_cs);
+    }
+    if(LATBbits.LATB3 != enc28j60_cs) {
+        enc28j60_cs = LATBbits.LATB3;
+        host_enc28j60_select(!enc28j60_cs);
+    }
+    if(LATAbits.LATA1 != enc28j60_reset) {
+        enc28j60_reset = LATAbits.LATA1;
+        host_enc28j60_reset(!enc28j60_reset);
+    }
+}
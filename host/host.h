@@ -0,0 +1,98 @@
+/*
+    Piconet RS232 ethernet interface
+
+    host.h
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; emulated peripherals and virtual time.
+
+All time is kept in instruction cycles (CCLK/4, so 12 cycles per microsecond). Firmware
+code itself runs at host speed and costs nothing, except for the fixed amounts charged
+below; everything the hardware does (SPI shifting, UART characters, delays) advances the
+virtual clock by what it would take on the real board. Pending interrupts are serviced
+whenever the clock advances, so ISRs preempt the main loop at about the same points as
+they would on the PIC.
+*/
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdio.h>
+
+/* Instruction cycles per microsecond */
+#define HOST_CYCLES_PER_US          12
+
+/* Fixed costs, in instruction cycles, of code the host does not time itself */
+#define HOST_CYCLES_MAINLOOP        150     // One pass through the main loop, without any work
+#define HOST_CYCLES_ISR             40      // Interrupt entry and exit, including context save
+#define HOST_CYCLES_RX_BYTE         35      // seriald_int_rx(), per byte taken from the receive FIFO
+#define HOST_CYCLES_SSP_CALL        14      // ssp_put()/ssp_get() call, flag handling and polling
+#define HOST_CYCLES_SSP_BLOCK       3       // Per byte in sspx_write_block()/sspx_read_block(), not overlapped with the transfer
+
+/* Virtual time */
+extern unsigned long long host_time;        // Instruction cycles since start
+void host_cycles(unsigned long cycles);     // Advance time, servicing interrupts
+
+/* Hooks used by the firmware */
+void host_mainloop(void);
+void host_reset(void);
+void host_pinchange(void);
+
+/* SPI busses; returns the byte shifted in */
+unsigned char host_spi_transfer(const unsigned char bus, const unsigned char data);
+void host_spi_block(const unsigned char bus, const unsigned char *out, unsigned char *in, unsigned short length);
+
+/* UART2 */
+void host_uart_init(int rx_fd, int tx_fd, const unsigned char xonxoff, const unsigned char escape, const unsigned long baudrate,
+                    const unsigned char wait);
+void host_uart_putchar(const unsigned char c);
+void host_uart_update(void);
+unsigned char host_uart_read(void);
+void host_uart_report(FILE *f);
+
+/* 25AA02E48 EEPROM */
+void host_eeprom_init(const char *filename);
+void host_eeprom_select(const unsigned char selected);
+unsigned char host_eeprom_transfer(const unsigned char data);
+
+void host_eeprom_program(const unsigned char address, const unsigned char *data, const unsigned char length);
+
+/* ENC28J60 */
+void host_enc28j60_init(void);
+void host_enc28j60_select(const unsigned char cs);
+void host_enc28j60_reset(const unsigned char asserted);
+unsigned char host_enc28j60_transfer(const unsigned char data);
+unsigned char host_enc28j60_receive(const unsigned char *frame, unsigned short length);
+unsigned char host_enc28j60_linkup(void);
+void host_enc28j60_update(void);
+
+/* Wire, pcap files and the external program */
+void host_net_init(const char *input, const char *output, const char *command, const unsigned char withpeer, const unsigned long latency, const unsigned long lose);
+void host_net_send(const unsigned char *frame, const unsigned short length);
+unsigned char host_net_receiving(void);
+void host_net_transmit(const unsigned char *frame, const unsigned short length);
+void host_net_update(void);
+
+/* TCP client, or UDP peer */
+#define HOST_PEER_PORT      40000
+void host_peer_address(const unsigned char piconet[4], unsigned char ip[4]);
+void host_peer_init(const unsigned char ip[4], const unsigned short port, const unsigned char udp, const int send, const int dump);
+void host_peer_receive(const unsigned char *frame, const unsigned short length);
+void host_peer_update(void);
+unsigned char host_peer_connected(void);
+unsigned long long host_peer_received(void);
+
+/* Statistics */
+unsigned long long host_spi_bytes(const unsigned char bus);
+void host_spi_report(FILE *f);
+void host_enc28j60_report(FILE *f);
+void host_net_report(FILE *f);
+void host_peer_report(FILE *f);
+
+#endif /* _HOST_H_ */
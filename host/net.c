@@ -0,0 +1,283 @@
+/*
+    Piconet RS232 ethernet interface
+
+    net.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; the wire between the ENC28J60 and the rest of the world.
+
+Frames towards the ENC28J60 are serialised at 10 Mbit/s and come from a pcap file, from
+the built-in peer (peer.c) or from an external program, optionally some time after
+they're sent to stand in for the round trip time of a longer path. Frames transmitted by
+the ENC28J60 go to a pcap file, the peer and the external program.
+
+The external program runs with a SOCK_SEQPACKET socket as its stdin and stdout, one
+frame (without FCS) per message. Virtual time does not wait for it; its frames are
+put on the wire as soon as they are seen.
+*/
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#define FRAME_MAX       1518
+#define QUEUE_SIZE      64
+
+/* 10 Mbit/s; 100 ns per bit */
+#define WIRE_CYCLES(bytes)      ((unsigned long long)(bytes) * 8 * HOST_CYCLES_PER_US / 10)
+/* Preamble and start-of-frame delimiter, frame check sequence */
+#define WIRE_OVERHEAD           (8 + 4)
+/* Inter-packet gap */
+#define WIRE_GAP                12
+
+/* Frames on their way to the ENC28J60 */
+static struct {
+    unsigned char data[FRAME_MAX];
+    unsigned short length;
+    unsigned long long arrival;             // Last bit received
+} queue[QUEUE_SIZE];
+static unsigned char queue_head, queue_count;
+static unsigned long long wire_free;        // Wire towards the ENC28J60 is idle again
+static unsigned long long wire_latency;     // Frames get on that wire this long after they're sent
+static unsigned long wire_lose;             // Every this many frames from the ENC28J60 one doesn't arrive
+
+/* pcap files */
+static FILE *pcap_in, *pcap_out;
+static unsigned long long pcap_start;       // Virtual time of the first record in pcap_in, once the link is up
+static bool pcap_started;
+static unsigned char pcap_frame[FRAME_MAX];
+static unsigned short pcap_length;
+static unsigned long long pcap_time;        // Offset of pcap_frame from the first record
+static unsigned long long pcap_first;       // Timestamp of the first record, in us
+static bool pcap_pending;
+
+/* External program */
+static int external = -1;
+
+static bool peer;
+
+static unsigned long stat_rx, stat_rx_dropped, stat_tx, stat_tx_lost;
+
+static unsigned long read32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static void write32(unsigned char *p, unsigned long value)
+{
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+static void pcap_next(void)
+/*!
+  Read the next record from pcap_in
+*/
+{
+    unsigned char header[16];
+    unsigned long long timestamp;
+    unsigned long length;
+
+    pcap_pending = FALSE;
+    while(fread(header, 1, sizeof(header), pcap_in) == sizeof(header)) {
+        timestamp = read32(header) * 1000000ULL + read32(&header[4]);
+        length = read32(&header[8]);
+        if(length > FRAME_MAX) {
+            fseek(pcap_in, length, SEEK_CUR);
+            continue;
+        }
+        if(fread(pcap_frame, 1, length, pcap_in) != length) {
+            break;
+        }
+        if(!pcap_first) {
+            pcap_first = timestamp;
+        }
+        pcap_length = length;
+        pcap_time = (timestamp - pcap_first) * HOST_CYCLES_PER_US;
+        pcap_pending = TRUE;
+        return;
+    }
+    fclose(pcap_in);
+    pcap_in = NULL;
+}
+
+void host_net_init(const char *input, const char *output, const char *command, const unsigned char withpeer, const unsigned long latency, const unsigned long lose)
+/*!
+  'latency' is in ms; with 'lose' set, every lose'th frame the ENC28J60 transmits is lost
+*/
+{
+    unsigned char header[24];
+    int sockets[2];
+
+    if(input) {
+        if(!(pcap_in = fopen(input, "rb")) || fread(header, 1, sizeof(header), pcap_in) != sizeof(header) ||
+           read32(header) != 0xA1B2C3D4 || read32(&header[20]) != 1) {
+            fprintf(stderr, "%s: not a little-endian ethernet pcap file\n", input);
+            exit(1);
+        }
+        pcap_next();
+    }
+
+    if(output) {
+        if(!(pcap_out = fopen(output, "wb"))) {
+            perror(output);
+            exit(1);
+        }
+        memset(header, 0, sizeof(header));
+        write32(header, 0xA1B2C3D4);
+        header[4] = 2;                      // Version 2.4
+        header[6] = 4;
+        write32(&header[16], 65535);        // Snapshot length
+        write32(&header[20], 1);            // Ethernet
+        fwrite(header, 1, sizeof(header), pcap_out);
+    }
+
+    if(command) {
+        if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        if(fork() == 0) {
+            dup2(sockets[1], STDIN_FILENO);
+            dup2(sockets[1], STDOUT_FILENO);
+            close(sockets[0]);
+            close(sockets[1]);
+            execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+            _exit(127);
+        }
+        close(sockets[1]);
+        external = sockets[0];
+        fcntl(external, F_SETFL, fcntl(external, F_GETFL) | O_NONBLOCK);
+    }
+
+    peer = withpeer;
+    wire_latency = latency * 1000ULL * HOST_CYCLES_PER_US;
+    wire_lose = lose;
+}
+
+void host_net_send(const unsigned char *frame, const unsigned short length)
+/*!
+  Put a frame on the wire towards the ENC28J60
+*/
+{
+    unsigned char i;
+    unsigned short padded = length < 60 ? 60 : length;
+
+    if(queue_count == QUEUE_SIZE || length > FRAME_MAX) {
+        stat_rx_dropped++;
+        return;
+    }
+    i = (queue_head + queue_count) % QUEUE_SIZE;
+    memcpy(queue[i].data, frame, length);
+    memset(&queue[i].data[length], 0, padded - length);
+    queue[i].length = padded;
+    if(wire_free < host_time + wire_latency) {
+        wire_free = host_time + wire_latency;
+    }
+    queue[i].arrival = wire_free + WIRE_CYCLES(padded + WIRE_OVERHEAD);
+    wire_free = queue[i].arrival + WIRE_CYCLES(WIRE_GAP);
+    queue_count++;
+}
+
+unsigned char host_net_receiving(void)
+/*!
+  Is a frame on its way into the ENC28J60 right now?
+*/
+{
+    return queue_count && host_time < queue[queue_head].arrival &&
+           host_time + WIRE_CYCLES(queue[queue_head].length + WIRE_OVERHEAD) >= queue[queue_head].arrival;
+}
+
+void host_net_transmit(const unsigned char *frame, const unsigned short length)
+/*!
+  The ENC28J60 transmitted a frame
+*/
+{
+    unsigned char header[16];
+
+    stat_tx++;
+    if(pcap_out) {
+        write32(header, host_time / (HOST_CYCLES_PER_US * 1000000ULL));
+        write32(&header[4], (host_time / HOST_CYCLES_PER_US) % 1000000);
+        write32(&header[8], length);
+        write32(&header[12], length);
+        fwrite(header, 1, sizeof(header), pcap_out);
+        fwrite(frame, 1, length, pcap_out);
+    }
+    if(wire_lose && stat_tx % wire_lose == 0) {
+        /* It's in the pcap file, as sent, but it never arrives */
+        stat_tx_lost++;
+        return;
+    }
+    if(external >= 0 && send(external, frame, length, MSG_DONTWAIT) < 0) {
+        close(external);
+        external = -1;
+    }
+    if(peer) {
+        host_peer_receive(frame, length);
+    }
+}
+
+void host_net_update(void)
+/*!
+  Called whenever time advances
+*/
+{
+    unsigned char frame[FRAME_MAX];
+    ssize_t r;
+
+    while(queue_count && host_time >= queue[queue_head].arrival) {
+        if(host_enc28j60_receive(queue[queue_head].data, queue[queue_head].length)) {
+            stat_rx++;
+        }
+        else {
+            stat_rx_dropped++;
+        }
+        queue_head = (queue_head + 1) % QUEUE_SIZE;
+        queue_count--;
+    }
+
+    if(pcap_pending) {
+        if(!pcap_started && host_enc28j60_linkup()) {
+            pcap_started = TRUE;
+            pcap_start = host_time;
+        }
+        while(pcap_started && pcap_pending && host_time >= pcap_start + pcap_time) {
+            host_net_send(pcap_frame, pcap_length);
+            pcap_next();
+        }
+    }
+
+    if(external >= 0) {
+        while((r = recv(external, frame, sizeof(frame), MSG_DONTWAIT)) > 0) {
+            host_net_send(frame, r);
+        }
+        if(r == 0) {
+            close(external);
+            external = -1;
+        }
+    }
+
+    if(peer) {
+        host_peer_update();
+    }
+}
+
+void host_net_report(FILE *f)
+{
+    fprintf(f, "Wire: %lu frames to the ENC28J60, %lu dropped, %lu frames from the ENC28J60, %lu lost\n", stat_rx, stat_rx_dropped, stat_tx, stat_tx_lost);
+    if(pcap_out) {
+        fflush(pcap_out);
+    }
+}
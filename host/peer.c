@@ -0,0 +1,530 @@
+/*
+    Piconet RS232 ethernet interface
+
+    peer.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; a TCP client on the wire, connecting to seriald.
+
+Just enough of ARP, IPv4 and TCP to open a connection, receive in-order data (checking
+every checksum along the way) and, optionally, send a file. Every segment is ACKed right
+away; out-of-order segments are dropped and answered with a duplicate ACK. Data is sent
+one segment at a time, with a fixed retransmission timeout.
+
+When seriald uses UDP, it's a UDP peer instead; it takes the datagrams seriald sends it,
+and sends a file as datagrams of a fixed size at a fixed interval, slow enough for the
+UART to keep up at the default baudrate.
+*/
+#include <config.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ETHTYPE_IP          0x0800
+#define ETHTYPE_ARP         0x0806
+
+#define TCP_FIN             0x01
+#define TCP_SYN             0x02
+#define TCP_RST             0x04
+#define TCP_PSH             0x08
+#define TCP_ACK             0x10
+
+#define PEER_PORT           HOST_PEER_PORT
+#define PEER_WINDOW         8192
+#define PEER_MSS            1460
+#define PEER_ISS            1000
+
+#define ARP_RETRY           (200000ULL * HOST_CYCLES_PER_US)
+#define SYN_RETRY           (1000000ULL * HOST_CYCLES_PER_US)
+#define RTO                 (500000ULL * HOST_CYCLES_PER_US)
+
+#define PEER_DATAGRAM       64
+#define DATAGRAM_INTERVAL   (100000ULL * HOST_CYCLES_PER_US)
+
+static const unsigned char mac_peer[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static unsigned char mac_piconet[6];
+static unsigned char ip_peer[4], ip_piconet[4];
+static unsigned short port_piconet;
+static bool udp;
+
+static unsigned char state;
+#define PEER_IDLE           0
+#define PEER_ARP            1
+#define PEER_SYNSENT        2
+#define PEER_ESTABLISHED    3
+#define PEER_CLOSED         4
+
+static unsigned long snd_una, snd_nxt, rcv_nxt;
+static unsigned short window_piconet, mss_piconet;
+static unsigned long long timer;
+
+/* Data towards the piconet, one segment in flight */
+static int send_fd = -1;
+static unsigned char sendbuffer[PEER_MSS];
+static unsigned short sendlength;
+
+/* Data from the piconet */
+static int dump_fd = -1;
+
+/* Statistics */
+static unsigned long long received, duplicate;
+static unsigned long long connected_at, last_data;
+static unsigned long long longest_wait;         // Between two in-order segments with data
+static unsigned long segments, outoforder, checksumerrors, acks, resets;
+static unsigned long datagrams;
+static unsigned long long sent;
+static unsigned long retransmits;
+
+static unsigned long checksum_add(unsigned long sum, const unsigned char *data, unsigned short length)
+{
+    while(length > 1) {
+        sum += (data[0] << 8) | data[1];
+        data += 2;
+        length -= 2;
+    }
+    if(length) {
+        sum += data[0] << 8;
+    }
+    return sum;
+}
+
+static unsigned short checksum_fold(unsigned long sum)
+{
+    while(sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+static unsigned long pseudoheader(const unsigned char *src, const unsigned char *dst, const unsigned char protocol, unsigned short length)
+{
+    unsigned long sum = 0;
+
+    sum = checksum_add(sum, src, 4);
+    sum = checksum_add(sum, dst, 4);
+    return sum + protocol + length;
+}
+
+static void put16(unsigned char *p, unsigned short value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static void put32(unsigned char *p, unsigned long value)
+{
+    put16(p, value >> 16);
+    put16(&p[2], value & 0xFFFF);
+}
+
+static unsigned short get16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static unsigned long get32(const unsigned char *p)
+{
+    return ((unsigned long)get16(p) << 16) | get16(&p[2]);
+}
+
+static void arp(const unsigned short opcode, const unsigned char *mac)
+{
+    unsigned char frame[42];
+
+    memcpy(frame, opcode == 1 ? (const unsigned char *)"\xFF\xFF\xFF\xFF\xFF\xFF" : mac, 6);
+    memcpy(&frame[6], mac_peer, 6);
+    put16(&frame[12], ETHTYPE_ARP);
+    put16(&frame[14], 1);                   // Ethernet
+    put16(&frame[16], ETHTYPE_IP);
+    frame[18] = 6;
+    frame[19] = 4;
+    put16(&frame[20], opcode);
+    memcpy(&frame[22], mac_peer, 6);
+    memcpy(&frame[28], ip_peer, 4);
+    memcpy(&frame[32], opcode == 1 ? (const unsigned char *)"\0\0\0\0\0\0" : mac, 6);
+    memcpy(&frame[38], ip_piconet, 4);
+    host_net_send(frame, sizeof(frame));
+}
+
+static void tcp(const unsigned char flags, const unsigned long seq, const unsigned char *data, const unsigned short length)
+{
+    unsigned char frame[14 + 20 + 24 + PEER_MSS];
+    unsigned char *ip = &frame[14];
+    unsigned char *th = &frame[34];
+    unsigned short headerlength = (flags & TCP_SYN) ? 24 : 20;
+
+    memcpy(frame, mac_piconet, 6);
+    memcpy(&frame[6], mac_peer, 6);
+    put16(&frame[12], ETHTYPE_IP);
+
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    put16(&ip[2], 20 + headerlength + length);
+    ip[8] = 64;
+    ip[9] = 6;
+    memcpy(&ip[12], ip_peer, 4);
+    memcpy(&ip[16], ip_piconet, 4);
+    put16(&ip[10], ~checksum_fold(checksum_add(0, ip, 20)));
+
+    memset(th, 0, headerlength);
+    put16(th, PEER_PORT);
+    put16(&th[2], port_piconet);
+    put32(&th[4], seq);
+    put32(&th[8], (flags & TCP_ACK) ? rcv_nxt : 0);
+    th[12] = (headerlength / 4) << 4;
+    th[13] = flags;
+    put16(&th[14], PEER_WINDOW);
+    if(flags & TCP_SYN) {
+        th[20] = 2;
+        th[21] = 4;
+        put16(&th[22], PEER_MSS);
+    }
+    memcpy(&th[headerlength], data, length);
+    put16(&th[16], ~checksum_fold(checksum_add(pseudoheader(ip_peer, ip_piconet, 6, headerlength + length), th, headerlength + length)));
+
+    if(flags & TCP_ACK) {
+        acks++;
+    }
+    host_net_send(frame, 34 + headerlength + length);
+}
+
+static void udp_output(const unsigned char *data, const unsigned short length)
+{
+    unsigned char frame[14 + 20 + 8 + PEER_DATAGRAM];
+    unsigned char *ip = &frame[14];
+    unsigned char *uh = &frame[34];
+    unsigned short checksum;
+
+    memcpy(frame, mac_piconet, 6);
+    memcpy(&frame[6], mac_peer, 6);
+    put16(&frame[12], ETHTYPE_IP);
+
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    put16(&ip[2], 20 + 8 + length);
+    ip[8] = 64;
+    ip[9] = 17;
+    memcpy(&ip[12], ip_peer, 4);
+    memcpy(&ip[16], ip_piconet, 4);
+    put16(&ip[10], ~checksum_fold(checksum_add(0, ip, 20)));
+
+    put16(uh, PEER_PORT);
+    put16(&uh[2], port_piconet);
+    put16(&uh[4], 8 + length);
+    put16(&uh[6], 0);
+    memcpy(&uh[8], data, length);
+    checksum = ~checksum_fold(checksum_add(pseudoheader(ip_peer, ip_piconet, 17, 8 + length), uh, 8 + length));
+    put16(&uh[6], checksum ? checksum : 0xFFFF);
+
+    host_net_send(frame, 34 + 8 + length);
+}
+
+void host_peer_address(const unsigned char piconet[4], unsigned char ip[4])
+/*!
+  The peer's address, next to the piconet's
+*/
+{
+    memcpy(ip, piconet, 4);
+    ip[3] = piconet[3] == 1 ? 2 : 1;
+}
+
+void host_peer_init(const unsigned char ip[4], const unsigned short port, const unsigned char useudp, const int send, const int dump)
+{
+    memcpy(ip_piconet, ip, 4);
+    host_peer_address(ip, ip_peer);
+    port_piconet = port;
+    udp = useudp;
+    send_fd = send;
+    dump_fd = dump;
+    state = PEER_IDLE;
+}
+
+static void tcp_input(const unsigned char *ip, const unsigned short length)
+{
+    unsigned short iphl = (ip[0] & 0x0F) * 4;
+    const unsigned char *th = &ip[iphl];
+    unsigned short tcplength = get16(&ip[2]) - iphl;
+    unsigned short thl, datalength, i;
+    unsigned long seq, ack;
+    unsigned char flags;
+
+    if(get16(&ip[2]) > length || tcplength < 20) {
+        return;
+    }
+    if(checksum_fold(checksum_add(pseudoheader(&ip[12], &ip[16], 6, tcplength), th, tcplength)) != 0xFFFF) {
+        checksumerrors++;
+        return;
+    }
+    if(get16(th) != port_piconet || get16(&th[2]) != PEER_PORT) {
+        return;
+    }
+    segments++;
+
+    seq = get32(&th[4]);
+    ack = get32(&th[8]);
+    thl = (th[12] >> 4) * 4;
+    flags = th[13];
+    datalength = tcplength - thl;
+    window_piconet = get16(&th[14]);
+
+    if(flags & TCP_RST) {
+        resets++;
+        state = PEER_CLOSED;
+        return;
+    }
+
+    if(state == PEER_SYNSENT) {
+        if((flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK) && ack == PEER_ISS + 1) {
+            rcv_nxt = seq + 1;
+            snd_una = snd_nxt = ack;
+            mss_piconet = 536;
+            for(i=20;i+3<thl;) {
+                if(th[i] == 2 && th[i+1] == 4) {
+                    mss_piconet = get16(&th[i+2]);
+                }
+                if(th[i] <= 1) {
+                    i++;
+                }
+                else {
+                    i += th[i+1];
+                }
+            }
+            tcp(TCP_ACK, snd_nxt, NULL, 0);
+            state = PEER_ESTABLISHED;
+            connected_at = host_time;
+            fprintf(stderr, "--- peer: connected at %.3f s\n", (double)host_time / (HOST_CYCLES_PER_US * 1000000.0));
+        }
+        return;
+    }
+    if(state != PEER_ESTABLISHED) {
+        return;
+    }
+
+    if((flags & TCP_ACK) && (long)(ack - snd_una) > 0 && (long)(ack - snd_nxt) <= 0) {
+        snd_una = ack;
+        if(snd_una == snd_nxt) {
+            sendlength = 0;
+        }
+    }
+
+    if(datalength || (flags & (TCP_SYN | TCP_FIN))) {
+        if(seq == rcv_nxt) {
+            if(datalength) {
+                if(dump_fd >= 0 && write(dump_fd, &th[thl], datalength) != datalength) {
+                    dump_fd = -1;
+                }
+                rcv_nxt += datalength;
+                received += datalength;
+                if(last_data && host_time - last_data > longest_wait) {
+                    longest_wait = host_time - last_data;
+                }
+                last_data = host_time;
+            }
+            if(flags & TCP_FIN) {
+                rcv_nxt++;
+                state = PEER_CLOSED;
+                fprintf(stderr, "--- peer: closed by piconet\n");
+            }
+        }
+        else if((long)(seq - rcv_nxt) < 0) {
+            duplicate += datalength;
+        }
+        else {
+            outoforder++;
+        }
+        tcp(TCP_ACK, snd_nxt, NULL, 0);
+    }
+}
+
+static void udp_input(const unsigned char *ip, const unsigned short length)
+{
+    unsigned short iphl = (ip[0] & 0x0F) * 4;
+    const unsigned char *uh = &ip[iphl];
+    unsigned short udplength = get16(&ip[2]) - iphl;
+
+    if(get16(&ip[2]) > length || udplength < 8 || get16(&uh[4]) != udplength) {
+        return;
+    }
+    if(get16(&uh[6]) == 0 ||
+       checksum_fold(checksum_add(pseudoheader(&ip[12], &ip[16], 17, udplength), uh, udplength)) != 0xFFFF) {
+        /* seriald always sends a checksum */
+        checksumerrors++;
+        return;
+    }
+    if(get16(uh) != port_piconet || get16(&uh[2]) != PEER_PORT) {
+        return;
+    }
+    datagrams++;
+    if(dump_fd >= 0 && write(dump_fd, &uh[8], udplength - 8) != udplength - 8) {
+        dump_fd = -1;
+    }
+    received += udplength - 8;
+    last_data = host_time;
+}
+
+void host_peer_receive(const unsigned char *frame, const unsigned short length)
+/*!
+  A frame transmitted by the ENC28J60
+*/
+{
+    const unsigned char *ip = &frame[14];
+
+    if(length < 42) {
+        return;
+    }
+    if(get16(&frame[12]) == ETHTYPE_ARP) {
+        if(memcmp(&frame[28], ip_piconet, 4) != 0) {
+            return;
+        }
+        memcpy(mac_piconet, &frame[22], 6);
+        if(get16(&frame[20]) == 1 && memcmp(&frame[38], ip_peer, 4) == 0) {
+            arp(2, mac_piconet);
+        }
+        if(state == PEER_ARP) {
+            state = udp ? PEER_ESTABLISHED : PEER_SYNSENT;
+            timer = 0;
+        }
+        return;
+    }
+    if(get16(&frame[12]) != ETHTYPE_IP || memcmp(frame, mac_peer, 6) != 0) {
+        return;
+    }
+    if(checksum_fold(checksum_add(0, ip, (ip[0] & 0x0F) * 4)) != 0xFFFF) {
+        checksumerrors++;
+        return;
+    }
+    if(ip[9] == 6 && memcmp(&ip[12], ip_piconet, 4) == 0 && memcmp(&ip[16], ip_peer, 4) == 0) {
+        tcp_input(ip, length - 14);
+    }
+    else if(ip[9] == 17 && udp && memcmp(&ip[12], ip_piconet, 4) == 0 && memcmp(&ip[16], ip_peer, 4) == 0) {
+        udp_input(ip, length - 14);
+    }
+}
+
+void host_peer_update(void)
+/*!
+  Called whenever time advances
+*/
+{
+    ssize_t r;
+    unsigned short length;
+
+    switch(state) {
+        case PEER_IDLE:
+            if(host_enc28j60_linkup()) {
+                if(udp && send_fd < 0) {
+                    /* Nothing to send, so no need for the piconet's MAC address; just
+                       wait for datagrams */
+                    state = PEER_ESTABLISHED;
+                    connected_at = host_time;
+                }
+                else {
+                    state = PEER_ARP;
+                    timer = 0;
+                }
+            }
+            break;
+        case PEER_ARP:
+            if(host_time >= timer) {
+                arp(1, NULL);
+                timer = host_time + ARP_RETRY;
+            }
+            break;
+        case PEER_SYNSENT:
+            if(host_time >= timer) {
+                snd_nxt = PEER_ISS;
+                tcp(TCP_SYN, PEER_ISS, NULL, 0);
+                timer = host_time + SYN_RETRY;
+            }
+            break;
+        case PEER_ESTABLISHED:
+            if(udp) {
+                if(!connected_at) {
+                    connected_at = host_time;
+                }
+                if(send_fd >= 0 && host_time >= timer) {
+                    r = read(send_fd, sendbuffer, PEER_DATAGRAM);
+                    if(r <= 0) {
+                        close(send_fd);
+                        send_fd = -1;
+                        break;
+                    }
+                    udp_output(sendbuffer, r);
+                    sent += r;
+                    timer = host_time + DATAGRAM_INTERVAL;
+                }
+            }
+            else if(sendlength && host_time >= timer) {
+                /* Retransmit */
+                tcp(TCP_ACK | TCP_PSH, snd_una, sendbuffer, sendlength);
+                retransmits++;
+                timer = host_time + RTO;
+            }
+            else if(!sendlength && send_fd >= 0) {
+                length = mss_piconet < window_piconet ? mss_piconet : window_piconet;
+                if(length > sizeof(sendbuffer)) {
+                    length = sizeof(sendbuffer);
+                }
+                if(length == 0) {
+                    if(host_time >= timer) {
+                        /* Window probe, in case the update that opens it again got lost; the
+                           byte is an old one, so piconet answers with an ACK and its window */
+                        tcp(TCP_ACK, snd_nxt - 1, sendbuffer, 1);
+                        timer = host_time + RTO;
+                    }
+                    break;
+                }
+                r = read(send_fd, sendbuffer, length);
+                if(r <= 0) {
+                    close(send_fd);
+                    send_fd = -1;
+                    break;
+                }
+                sendlength = r;
+                tcp(TCP_ACK | TCP_PSH, snd_nxt, sendbuffer, sendlength);
+                snd_nxt += sendlength;
+                sent += sendlength;
+                timer = host_time + RTO;
+            }
+            break;
+    }
+}
+
+unsigned char host_peer_connected(void)
+/*!
+  Connected to seriald; with UDP, as soon as the address is resolved
+*/
+{
+    return state == PEER_ESTABLISHED;
+}
+
+unsigned long long host_peer_received(void)
+{
+    return received;
+}
+
+void host_peer_report(FILE *f)
+{
+    double seconds;
+
+    if(udp) {
+        fprintf(f, "Peer: %llu bytes received in %lu datagrams, %lu checksum errors\n", received, datagrams, checksumerrors);
+        fprintf(f, "Peer: %llu bytes sent\n", sent);
+    }
+    else {
+        fprintf(f, "Peer: %llu bytes received in order, %llu duplicate, %lu segments, %lu out of order, %lu checksum errors, %lu ACKs, %lu resets\n",
+                received, duplicate, segments, outoforder, checksumerrors, acks, resets);
+        fprintf(f, "Peer: %llu bytes sent, %lu retransmissions\n", sent, retransmits);
+        fprintf(f, "Peer: waited at most %.1f ms for the next data in order\n", (double)longest_wait / (HOST_CYCLES_PER_US * 1000.0));
+    }
+    if(connected_at && last_data > connected_at) {
+        seconds = (double)(last_data - connected_at) / (HOST_CYCLES_PER_US * 1000000.0);
+        fprintf(f, "Peer: %.0f bytes/s from connect to last data\n", received / seconds);
+    }
+}
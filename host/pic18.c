@@ -0,0 +1,57 @@
+/*
+    Piconet RS232 ethernet interface
+
+    pic18.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Special function register storage for the host build, see pic18.h
+*/
+#include <config.h>
+
+volatile unsigned char ANCON0, ANCON1;
+volatile unsigned char TRISA, TRISB, TRISC;
+volatile unsigned char EECON2;
+volatile unsigned char RPINR1, RPINR16, RPINR21, RPINR22;
+volatile unsigned char RPOR2, RPOR4, RPOR5;
+volatile unsigned char TMR1H, TMR1L, TMR3H, TMR3L;
+volatile unsigned char SSP1BUF, SSP2BUF;
+volatile unsigned char SPBRG1, SPBRGH1, TXREG1, RCREG1;
+volatile unsigned char SPBRG2, SPBRGH2, TXREG2;
+
+volatile OSCCONbits_t OSCCONbits;
+volatile OSCTUNEbits_t OSCTUNEbits;
+volatile WDTCONbits_t WDTCONbits;
+volatile UCONbits_t UCONbits;
+volatile UCFGbits_t UCFGbits;
+volatile PORTAbits_t PORTAbits;
+volatile LATAbits_t LATAbits;
+volatile LATBbits_t LATBbits;
+volatile LATCbits_t LATCbits;
+volatile PPSCONbits_t PPSCONbits;
+volatile INTCONbits_t INTCONbits;
+volatile INTCON2bits_t INTCON2bits;
+volatile INTCON3bits_t INTCON3bits;
+volatile RCONbits_t RCONbits;
+volatile PIR1bits_t PIR1bits;
+volatile PIE1bits_t PIE1bits;
+volatile IPR1bits_t IPR1bits;
+volatile PIR2bits_t PIR2bits;
+volatile PIR3bits_t PIR3bits;
+volatile PIE3bits_t PIE3bits;
+volatile IPR3bits_t IPR3bits;
+volatile ALRMCFGbits_t ALRMCFGbits;
+volatile RTCCFGbits_t RTCCFGbits;
+volatile T1CONbits_t T1CONbits;
+volatile T3CONbits_t T3CONbits;
+volatile SSPSTATbits_t SSP1STATbits, SSP2STATbits;
+volatile SSPCON1bits_t SSP1CON1bits, SSP2CON1bits;
+volatile TXSTAbits_t TXSTA1bits, TXSTA2bits;
+volatile RCSTAbits_t RCSTA1bits, host_rcsta2;
+volatile BAUDCONbits_t BAUDCON1bits, BAUDCON2bits;
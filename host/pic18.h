@@ -0,0 +1,544 @@
+/*
+    Piconet RS232 ethernet interface
+
+    pic18.h
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+PIC18F27J53 special function registers, as used by the firmware, for the host build.
+Registers are plain variables here; host.c inspects and updates them as (virtual) time
+passes. Bit-layouts follow the datasheet, so byte- and bit-wise access can be mixed.
+*/
+#ifndef _HOST_PIC18_H_
+#define _HOST_PIC18_H_
+
+#include "host.h"
+
+/* Plain registers */
+extern volatile unsigned char ANCON0, ANCON1;
+extern volatile unsigned char TRISA, TRISB, TRISC;
+extern volatile unsigned char EECON2;
+extern volatile unsigned char RPINR1, RPINR16, RPINR21, RPINR22;
+extern volatile unsigned char RPOR2, RPOR4, RPOR5;
+extern volatile unsigned char TMR1H, TMR1L, TMR3H, TMR3L;
+extern volatile unsigned char SSP1BUF, SSP2BUF;
+extern volatile unsigned char SPBRG1, SPBRGH1, TXREG1, RCREG1;
+extern volatile unsigned char SPBRG2, SPBRGH2, TXREG2;
+#define RCREG2      host_uart_read()    // Reading pops the receive FIFO
+
+/* Oscillator, watchdog and USB */
+typedef union {
+    struct {
+        unsigned SCS0:1;
+        unsigned SCS1:1;
+        unsigned FLTS:1;
+        unsigned OSTS:1;
+        unsigned IRCF0:1;
+        unsigned IRCF1:1;
+        unsigned IRCF2:1;
+        unsigned IDLEN:1;
+    };
+    unsigned char reg;
+} OSCCONbits_t;
+extern volatile OSCCONbits_t OSCCONbits;
+#define OSCCON      OSCCONbits.reg
+
+typedef union {
+    struct {
+        unsigned TUN:6;
+        unsigned PLLEN:1;
+        unsigned INTSRC:1;
+    };
+    unsigned char reg;
+} OSCTUNEbits_t;
+extern volatile OSCTUNEbits_t OSCTUNEbits;
+#define OSCTUNE     OSCTUNEbits.reg
+
+typedef union {
+    struct {
+        unsigned SWDTEN:1;
+        unsigned :7;
+    };
+    unsigned char reg;
+} WDTCONbits_t;
+extern volatile WDTCONbits_t WDTCONbits;
+#define WDTCON      WDTCONbits.reg
+
+typedef union {
+    struct {
+        unsigned :1;
+        unsigned SUSPND:1;
+        unsigned RESUME:1;
+        unsigned USBEN:1;
+        unsigned PKTDIS:1;
+        unsigned SE0:1;
+        unsigned PPBRST:1;
+        unsigned :1;
+    };
+    unsigned char reg;
+} UCONbits_t;
+extern volatile UCONbits_t UCONbits;
+#define UCON        UCONbits.reg
+
+typedef union {
+    struct {
+        unsigned PPB0:1;
+        unsigned PPB1:1;
+        unsigned FSEN:1;
+        unsigned UTRDIS:1;
+        unsigned UPUEN:1;
+        unsigned :1;
+        unsigned UOEMON:1;
+        unsigned UTEYE:1;
+    };
+    unsigned char reg;
+} UCFGbits_t;
+extern volatile UCFGbits_t UCFGbits;
+#define UCFG        UCFGbits.reg
+
+/* I/O ports */
+typedef union {
+    struct {
+        unsigned RA0:1;
+        unsigned RA1:1;
+        unsigned RA2:1;
+        unsigned RA3:1;
+        unsigned RA4:1;
+        unsigned RA5:1;
+        unsigned RA6:1;
+        unsigned RA7:1;
+    };
+    unsigned char reg;
+} PORTAbits_t;
+extern volatile PORTAbits_t PORTAbits;
+#define PORTA       PORTAbits.reg
+
+typedef union {
+    struct {
+        unsigned LATA0:1;
+        unsigned LATA1:1;
+        unsigned LATA2:1;
+        unsigned LATA3:1;
+        unsigned LATA4:1;
+        unsigned LATA5:1;
+        unsigned LATA6:1;
+        unsigned LATA7:1;
+    };
+    unsigned char reg;
+} LATAbits_t;
+extern volatile LATAbits_t LATAbits;
+#define LATA        LATAbits.reg
+
+typedef union {
+    struct {
+        unsigned LATB0:1;
+        unsigned LATB1:1;
+        unsigned LATB2:1;
+        unsigned LATB3:1;
+        unsigned LATB4:1;
+        unsigned LATB5:1;
+        unsigned LATB6:1;
+        unsigned LATB7:1;
+    };
+    unsigned char reg;
+} LATBbits_t;
+extern volatile LATBbits_t LATBbits;
+#define LATB        LATBbits.reg
+
+typedef union {
+    struct {
+        unsigned LATC0:1;
+        unsigned LATC1:1;
+        unsigned LATC2:1;
+        unsigned LATC3:1;
+        unsigned LATC4:1;
+        unsigned LATC5:1;
+        unsigned LATC6:1;
+        unsigned LATC7:1;
+    };
+    unsigned char reg;
+} LATCbits_t;
+extern volatile LATCbits_t LATCbits;
+#define LATC        LATCbits.reg
+
+typedef union {
+    struct {
+        unsigned IOLOCK:1;
+        unsigned :7;
+    };
+    unsigned char reg;
+} PPSCONbits_t;
+extern volatile PPSCONbits_t PPSCONbits;
+#define PPSCON      PPSCONbits.reg
+
+/* Interrupt control */
+typedef union {
+    struct {
+        unsigned RBIF:1;
+        unsigned INT0IF:1;
+        unsigned TMR0IF:1;
+        unsigned RBIE:1;
+        unsigned INT0IE:1;
+        unsigned TMR0IE:1;
+        unsigned PEIE:1;
+        unsigned GIE:1;
+    };
+    struct {
+        unsigned :6;
+        unsigned GIEL:1;
+        unsigned GIEH:1;
+    };
+    unsigned char reg;
+} INTCONbits_t;
+extern volatile INTCONbits_t INTCONbits;
+#define INTCON      INTCONbits.reg
+
+typedef union {
+    struct {
+        unsigned RBIP:1;
+        unsigned INT3IP:1;
+        unsigned TMR0IP:1;
+        unsigned INTEDG3:1;
+        unsigned INTEDG2:1;
+        unsigned INTEDG1:1;
+        unsigned INTEDG0:1;
+        unsigned RBPU:1;
+    };
+    unsigned char reg;
+} INTCON2bits_t;
+extern volatile INTCON2bits_t INTCON2bits;
+#define INTCON2     INTCON2bits.reg
+
+typedef union {
+    struct {
+        unsigned INT1IF:1;
+        unsigned INT2IF:1;
+        unsigned INT3IF:1;
+        unsigned INT1IE:1;
+        unsigned INT2IE:1;
+        unsigned INT3IE:1;
+        unsigned INT1IP:1;
+        unsigned INT2IP:1;
+    };
+    unsigned char reg;
+} INTCON3bits_t;
+extern volatile INTCON3bits_t INTCON3bits;
+#define INTCON3     INTCON3bits.reg
+
+typedef union {
+    struct {
+        unsigned BOR:1;
+        unsigned POR:1;
+        unsigned PD:1;
+        unsigned TO:1;
+        unsigned RI:1;
+        unsigned CM:1;
+        unsigned :1;
+        unsigned IPEN:1;
+    };
+    unsigned char reg;
+} RCONbits_t;
+extern volatile RCONbits_t RCONbits;
+#define RCON        RCONbits.reg
+
+/* PIR1, PIE1 and IPR1 share their layout */
+typedef union {
+    struct {
+        unsigned TMR1IF:1;
+        unsigned TMR2IF:1;
+        unsigned CCP1IF:1;
+        unsigned SSP1IF:1;
+        unsigned TX1IF:1;
+        unsigned RC1IF:1;
+        unsigned ADIF:1;
+        unsigned PMPIF:1;
+    };
+    struct {
+        unsigned :4;
+        unsigned TXIF:1;
+        unsigned RCIF:1;
+        unsigned :2;
+    };
+    unsigned char reg;
+} PIR1bits_t;
+extern volatile PIR1bits_t PIR1bits;
+#define PIR1        PIR1bits.reg
+
+typedef union {
+    struct {
+        unsigned TMR1IE:1;
+        unsigned TMR2IE:1;
+        unsigned CCP1IE:1;
+        unsigned SSP1IE:1;
+        unsigned TX1IE:1;
+        unsigned RC1IE:1;
+        unsigned ADIE:1;
+        unsigned PMPIE:1;
+    };
+    struct {
+        unsigned :4;
+        unsigned TXIE:1;
+        unsigned RCIE:1;
+        unsigned :2;
+    };
+    unsigned char reg;
+} PIE1bits_t;
+extern volatile PIE1bits_t PIE1bits;
+#define PIE1        PIE1bits.reg
+
+typedef union {
+    struct {
+        unsigned TMR1IP:1;
+        unsigned TMR2IP:1;
+        unsigned CCP1IP:1;
+        unsigned SSP1IP:1;
+        unsigned TX1IP:1;
+        unsigned RC1IP:1;
+        unsigned ADIP:1;
+        unsigned PMPIP:1;
+    };
+    struct {
+        unsigned :4;
+        unsigned TXIP:1;
+        unsigned RCIP:1;
+        unsigned :2;
+    };
+    unsigned char reg;
+} IPR1bits_t;
+extern volatile IPR1bits_t IPR1bits;
+#define IPR1        IPR1bits.reg
+
+typedef union {
+    struct {
+        unsigned CCP2IF:1;
+        unsigned TMR3IF:1;
+        unsigned LVDIF:1;
+        unsigned BCL1IF:1;
+        unsigned USBIF:1;
+        unsigned CM1IF:1;
+        unsigned CM2IF:1;
+        unsigned OSCFIF:1;
+    };
+    unsigned char reg;
+} PIR2bits_t;
+extern volatile PIR2bits_t PIR2bits;
+#define PIR2        PIR2bits.reg
+
+/* PIR3, PIE3 and IPR3 share their layout */
+typedef union {
+    struct {
+        unsigned RTCCIF:1;
+        unsigned TMR3GIF:1;
+        unsigned CTMUIF:1;
+        unsigned TMR4IF:1;
+        unsigned TX2IF:1;
+        unsigned RC2IF:1;
+        unsigned BCL2IF:1;
+        unsigned SSP2IF:1;
+    };
+    unsigned char reg;
+} PIR3bits_t;
+extern volatile PIR3bits_t PIR3bits;
+#define PIR3        PIR3bits.reg
+
+typedef union {
+    struct {
+        unsigned RTCCIE:1;
+        unsigned TMR3GIE:1;
+        unsigned CTMUIE:1;
+        unsigned TMR4IE:1;
+        unsigned TX2IE:1;
+        unsigned RC2IE:1;
+        unsigned BCL2IE:1;
+        unsigned SSP2IE:1;
+    };
+    unsigned char reg;
+} PIE3bits_t;
+extern volatile PIE3bits_t PIE3bits;
+#define PIE3        PIE3bits.reg
+
+typedef union {
+    struct {
+        unsigned RTCCIP:1;
+        unsigned TMR3GIP:1;
+        unsigned CTMUIP:1;
+        unsigned TMR4IP:1;
+        unsigned TX2IP:1;
+        unsigned RC2IP:1;
+        unsigned BCL2IP:1;
+        unsigned SSP2IP:1;
+    };
+    unsigned char reg;
+} IPR3bits_t;
+extern volatile IPR3bits_t IPR3bits;
+#define IPR3        IPR3bits.reg
+
+/* RTC */
+typedef union {
+    struct {
+        unsigned ALRMPTR0:1;
+        unsigned ALRMPTR1:1;
+        unsigned AMASK0:1;
+        unsigned AMASK1:1;
+        unsigned AMASK2:1;
+        unsigned AMASK3:1;
+        unsigned CHIME:1;
+        unsigned ALRMEN:1;
+    };
+    unsigned char reg;
+} ALRMCFGbits_t;
+extern volatile ALRMCFGbits_t ALRMCFGbits;
+#define ALRMCFG     ALRMCFGbits.reg
+
+typedef union {
+    struct {
+        unsigned RTCPTR0:1;
+        unsigned RTCPTR1:1;
+        unsigned RTCOE:1;
+        unsigned HALFSEC:1;
+        unsigned RTCSYNC:1;
+        unsigned RTCWREN:1;
+        unsigned :1;
+        unsigned RTCEN:1;
+    };
+    unsigned char reg;
+} RTCCFGbits_t;
+extern volatile RTCCFGbits_t RTCCFGbits;
+#define RTCCFG      RTCCFGbits.reg
+
+/* Timer1 */
+typedef union {
+    struct {
+        unsigned TMR1ON:1;
+        unsigned RD16:1;
+        unsigned T1SYNC:1;
+        unsigned T1OSCEN:1;
+        unsigned T1CKPS0:1;
+        unsigned T1CKPS1:1;
+        unsigned TMR1CS0:1;
+        unsigned TMR1CS1:1;
+    };
+    unsigned char reg;
+} T1CONbits_t;
+extern volatile T1CONbits_t T1CONbits;
+#define T1CON       T1CONbits.reg
+
+/* Timer3 */
+typedef union {
+    struct {
+        unsigned TMR3ON:1;
+        unsigned RD16:1;
+        unsigned T3SYNC:1;
+        unsigned T3OSCEN:1;
+        unsigned T3CKPS0:1;
+        unsigned T3CKPS1:1;
+        unsigned TMR3CS0:1;
+        unsigned TMR3CS1:1;
+    };
+    unsigned char reg;
+} T3CONbits_t;
+extern volatile T3CONbits_t T3CONbits;
+#define T3CON       T3CONbits.reg
+
+/* MSSP1 and MSSP2, SPI mode */
+typedef union {
+    struct {
+        unsigned BF:1;
+        unsigned UA:1;
+        unsigned R_W:1;
+        unsigned S:1;
+        unsigned P:1;
+        unsigned D_A:1;
+        unsigned CKE:1;
+        unsigned SMP:1;
+    };
+    unsigned char reg;
+} SSPSTATbits_t;
+extern volatile SSPSTATbits_t SSP1STATbits, SSP2STATbits;
+#define SSP1STAT    SSP1STATbits.reg
+#define SSP2STAT    SSP2STATbits.reg
+
+typedef union {
+    struct {
+        unsigned SSPM0:1;
+        unsigned SSPM1:1;
+        unsigned SSPM2:1;
+        unsigned SSPM3:1;
+        unsigned CKP:1;
+        unsigned SSPEN:1;
+        unsigned SSPOV:1;
+        unsigned WCOL:1;
+    };
+    unsigned char reg;
+} SSPCON1bits_t;
+extern volatile SSPCON1bits_t SSP1CON1bits, SSP2CON1bits;
+#define SSP1CON1    SSP1CON1bits.reg
+#define SSP2CON1    SSP2CON1bits.reg
+
+/* EUSART1 and EUSART2 */
+typedef union {
+    struct {
+        unsigned TX9D:1;
+        unsigned TRMT:1;
+        unsigned BRGH:1;
+        unsigned SENDB:1;
+        unsigned SYNC:1;
+        unsigned TXEN:1;
+        unsigned TX9:1;
+        unsigned CSRC:1;
+    };
+    unsigned char reg;
+} TXSTAbits_t;
+extern volatile TXSTAbits_t TXSTA1bits, TXSTA2bits;
+#define TXSTA1      TXSTA1bits.reg
+#define TXSTA2      TXSTA2bits.reg
+
+typedef union {
+    struct {
+        unsigned RX9D:1;
+        unsigned OERR:1;
+        unsigned FERR:1;
+        unsigned ADDEN:1;
+        unsigned CREN:1;
+        unsigned SREN:1;
+        unsigned RX9:1;
+        unsigned SPEN:1;
+    };
+    unsigned char reg;
+} RCSTAbits_t;
+extern volatile RCSTAbits_t RCSTA1bits, host_rcsta2;
+/* Every access goes through the UART model, so it sees CREN being toggled */
+volatile RCSTAbits_t *host_uart_rcsta(void);
+#define RCSTA2bits  (*host_uart_rcsta())
+#define RCSTA1      RCSTA1bits.reg
+#define RCSTA2      RCSTA2bits.reg
+
+typedef union {
+    struct {
+        unsigned ABDEN:1;
+        unsigned WUE:1;
+        unsigned :1;
+        unsigned BRG16:1;
+        unsigned TXCKP:1;
+        unsigned RXDTP:1;
+        unsigned RCIDL:1;
+        unsigned ABDOVF:1;
+    };
+    unsigned char reg;
+} BAUDCONbits_t;
+extern volatile BAUDCONbits_t BAUDCON1bits, BAUDCON2bits;
+#define BAUDCON1    BAUDCON1bits.reg
+#define BAUDCON2    BAUDCON2bits.reg
+
+/* Instructions */
+#define RESET()             host_reset()
+#define NOP()               host_cycles(1)
+#define CLEAR_WATCHDOG()    host_mainloop()
+
+#endif /* _HOST_PIC18_H_ */
@@ -0,0 +1,113 @@
+/*
+    Piconet RS232 ethernet interface
+
+    spi.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; SPI busses.
+
+SSP1 connects to the SD card, SSP2 to the ENC28J60 and the EEPROM. Each byte goes to
+whichever device has its chip select asserted, and takes 8 SPI clocks at the rate
+selected in SSPxCON1.
+*/
+#include <config.h>
+
+static unsigned long long bytes[2];
+static unsigned long long cycles[2];
+
+static unsigned long clock_divider(const unsigned char sspm)
+/*!
+  Instruction cycles per SPI clock, for the given SSPM bits
+*/
+{
+    switch(sspm) {
+        case 0x00:  return 1;       // Fosc/4
+        case 0x0A:  return 2;       // Fosc/8
+        case 0x01:  return 4;       // Fosc/16
+        case 0x02:  return 16;      // Fosc/64
+        default:    return 16;
+    }
+}
+
+static unsigned char transfer(const unsigned char bus, const unsigned char data, const unsigned long overhead)
+/*!
+  Move one byte over the given bus, taking 'overhead' instruction cycles on top of the
+  SPI clocks
+*/
+{
+    unsigned char in;
+    unsigned long time;
+
+    if(bus == 1) {
+        /* No SD card; an idle MISO line reads as all ones */
+        in = 0xFF;
+        time = overhead + 8 * clock_divider(SSP1CON1 & 0x0F);
+    }
+    else {
+        if(!LATAbits.LATA6) {
+            in = host_eeprom_transfer(data);
+        }
+        else if(!LATBbits.LATB3) {
+            in = host_enc28j60_transfer(data);
+        }
+        else {
+            /* Nothing selected */
+            in = 0x00;
+        }
+        time = overhead + 8 * clock_divider(SSP2CON1 & 0x0F);
+    }
+    bytes[bus-1]++;
+    cycles[bus-1] += time;
+
+    host_cycles(time);
+    return in;
+}
+
+unsigned char host_spi_transfer(const unsigned char bus, const unsigned char data)
+{
+    return transfer(bus, data, HOST_CYCLES_SSP_CALL);
+}
+
+void host_spi_block(const unsigned char bus, const unsigned char *out, unsigned char *in, unsigned short length)
+/*!
+  sspx_write_block() ('in' is NULL) and sspx_read_block() ('out' is NULL); one call, then
+  a few cycles per byte
+*/
+{
+    unsigned char data;
+    unsigned long overhead = HOST_CYCLES_SSP_CALL;
+
+    while(length) {
+        data = transfer(bus, out ? *out : 0xFF, overhead);
+        if(out) {
+            out++;
+        }
+        if(in) {
+            *in = data;
+            in++;
+        }
+        overhead = HOST_CYCLES_SSP_BLOCK;
+        length--;
+    }
+}
+
+unsigned long long host_spi_bytes(const unsigned char bus)
+{
+    return bytes[bus-1];
+}
+
+void host_spi_report(FILE *f)
+{
+    unsigned char i;
+
+    for(i=0;i<2;i++) {
+        fprintf(f, "SSP%d: %llu bytes, %.3f ms bus time\n", i+1, bytes[i], (double)cycles[i] / (HOST_CYCLES_PER_US * 1000.0));
+    }
+}
@@ -0,0 +1,347 @@
+/*
+    Piconet RS232 ethernet interface
+
+    uart.c
+
+    Copyright (c) 2018 Bastiaan van Kesteren <bas@edeation.nl>
+    This program comes with ABSOLUTELY NO WARRANTY; for details see the file LICENSE.
+    This program is free software; you can redistribute it and/or modify it under the terms
+    of the GNU General Public License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+*/
+/*!
+\file
+Host build; UART2 model.
+
+Received characters come from a file descriptor and arrive back-to-back at the configured
+baudrate, into a 2 character FIFO, just like the EUSART does. The other side holds the
+next character while RTS is deasserted. Transmitted characters go out through a TXREG and
+a shift register, and are written to a file descriptor; the other side is always ready
+for them, so CTS stays asserted.
+
+The other side can send at a baudrate of its own. A character sent more than 5% off the
+baudrate generator's arrives with a framing error. With auto-baud detection enabled, the
+next character is measured as the sync character would be.
+
+The other side can wait with sending until the built-in TCP client or UDP peer is
+connected, and the receive interrupt is enabled; so none of its data is lost while seriald
+has nobody to send it to.
+
+With XON/XOFF, the other side holds the next character after it received XOFF, and
+doesn't write XON and XOFF out. With escaping, it escapes what it sends and unescapes
+what it receives (see serial.h), so the file descriptors carry the plain data.
+
+Reading a character costs HOST_CYCLES_RX_BYTE. How long characters wait for that, while
+the receive interrupt is enabled, is checked against the time the FIFO gives before it
+overruns; see host_uart_report().
+*/
+#include <config.h>
+#include "serial.h"
+#include <unistd.h>
+#include <fcntl.h>
+
+static int rx_fd = -1, tx_fd = -1;
+
+static unsigned char rx_fifo[2];
+static bool rx_ferr[2];                     // The characters in rx_fifo had a framing error
+static unsigned long long rx_arrival[2];    // When the characters in rx_fifo were complete..
+static bool rx_armed[2];                    // ..and if the receive interrupt was enabled then
+static unsigned char rx_count;
+static unsigned char rx_buffer[256];        // Read from rx_fd, not yet on the wire
+static unsigned int rx_buffered, rx_index;
+static unsigned long long rx_next;          // When the character being received is complete
+static bool rx_held;                        // RTS was deasserted, or XOFF received, at the end of the last character
+static bool rx_xoff;                        // XOFF received
+static bool rx_escaping;                    // SERIAL_ESCAPE is sent, the character it escapes is next
+static unsigned long rx_baudrate;           // Of the other side, 0 when it follows the baudrate generator
+static bool rx_waiting;                     // Other side doesn't send until seriald has a client
+
+static bool tx_full;                        // TXREG holds a character
+static unsigned char tx_reg;
+static bool tx_escaped;                     // SERIAL_ESCAPE was received, the character it escapes is next
+
+static bool xonxoff, escape;
+static unsigned long long tx_shift_done;    // When the shift register is empty again
+
+static unsigned long rx_bytes, rx_overruns, tx_bytes, tx_xoffs;
+static unsigned long rx_framingerrors, rx_autobauds;
+static unsigned long rx_missed;             // Overruns while the receive interrupt was enabled
+static unsigned long long rx_maxwait;       // Longest a character waited for the receive interrupt
+static unsigned long rx_budget;             // Longest it could have waited, at the fastest baudrate seen
+
+static unsigned long character_time(void)
+/*!
+  Instruction cycles per character (start bit, 8 data bits, stop bit),
+  following the baudrate generator settings
+*/
+{
+    unsigned long brg;
+    unsigned long bit;
+
+    if(BAUDCON2bits.BRG16) {
+        brg = ((unsigned long)SPBRGH2 << 8) | SPBRG2;
+    }
+    else {
+        brg = SPBRG2;
+    }
+    /* Baudrate is CCLK/(multiplier*(n+1)), an instruction cycle is 4 clocks */
+    if(BAUDCON2bits.BRG16 && TXSTA2bits.BRGH) {
+        bit = (brg + 1);
+    }
+    else if(BAUDCON2bits.BRG16 || TXSTA2bits.BRGH) {
+        bit = 4 * (brg + 1);
+    }
+    else {
+        bit = 16 * (brg + 1);
+    }
+    return 10 * bit;
+}
+
+static unsigned long sender_character_time(void)
+/*!
+  Instruction cycles per character sent by the other side
+*/
+{
+    if(rx_baudrate) {
+        return 10 * (HOST_CYCLES_PER_US * 1000000UL) / rx_baudrate;
+    }
+    return character_time();
+}
+
+static void rx_push(const unsigned char c, const bool ferr)
+/*!
+  A character is complete; into the FIFO, if there's room
+*/
+{
+    if(RCSTA2bits.SPEN && RCSTA2bits.CREN && !RCSTA2bits.OERR) {
+        if(rx_count < sizeof(rx_fifo)) {
+            rx_arrival[rx_count] = rx_next;
+            rx_armed[rx_count] = PIE3bits.RC2IE;
+            rx_ferr[rx_count] = ferr;
+            rx_fifo[rx_count++] = c;
+            rx_bytes++;
+            if(ferr) {
+                rx_framingerrors++;
+            }
+        }
+        else {
+            RCSTA2bits.OERR = 1;
+            rx_overruns++;
+            if(PIE3bits.RC2IE) {
+                rx_missed++;
+            }
+        }
+    }
+    else {
+        rx_overruns++;
+    }
+}
+
+static void rx_receive(const unsigned char c)
+/*!
+  The other side sent a character
+*/
+{
+    unsigned long ours = character_time(), theirs = sender_character_time();
+    unsigned long bit;
+
+    if(BAUDCON2bits.ABDEN) {
+        /* Auto-baud detection; the baudrate generator ends up at the instruction cycles
+           per bit, see serial.h. No character, just the interrupt flag */
+        bit = theirs / 10;
+        if(bit > 0xFFFF) {
+            BAUDCON2bits.ABDOVF = 1;
+        }
+        SPBRGH2 = bit >> 8;
+        SPBRG2 = bit & 0xFF;
+        BAUDCON2bits.ABDEN = 0;
+        rx_autobauds++;
+        rx_push(0x00, FALSE);
+        return;
+    }
+    rx_push(c, (ours > theirs ? ours - theirs : theirs - ours) * 20 > theirs);
+}
+
+void host_uart_init(int rx, int tx, const unsigned char withxonxoff, const unsigned char withescape, const unsigned long baudrate,
+                    const unsigned char wait)
+/*!
+  'baudrate' is the other side's, 0 to follow the baudrate generator. With 'wait' set, the
+  other side starts sending once seriald has a client
+*/
+{
+    rx_fd = rx;
+    tx_fd = tx;
+    xonxoff = withxonxoff;
+    escape = withxonxoff && withescape;
+    rx_baudrate = baudrate;
+    rx_waiting = wait;
+    if(rx_fd >= 0) {
+        fcntl(rx_fd, F_SETFL, fcntl(rx_fd, F_GETFL) | O_NONBLOCK);
+    }
+    /* CTS is active low */
+    PORTAbits.RA2 = 0;
+}
+
+static void tx_update(void)
+{
+    if(tx_full && host_time >= tx_shift_done) {
+        /* Move TXREG into the shift register */
+        tx_full = FALSE;
+        tx_shift_done = host_time + character_time();
+        tx_bytes++;
+        if(xonxoff && (tx_reg == SERIAL_XOFF || tx_reg == SERIAL_XON)) {
+            /* For the sender, see rx_update() */
+            rx_xoff = tx_reg == SERIAL_XOFF;
+            if(rx_xoff) {
+                tx_xoffs++;
+            }
+        }
+        else if(escape && !tx_escaped && tx_reg == SERIAL_ESCAPE) {
+            tx_escaped = TRUE;
+        }
+        else {
+            if(tx_escaped) {
+                tx_reg ^= SERIAL_ESCAPE_XOR;
+                tx_escaped = FALSE;
+            }
+            if(tx_fd >= 0 && write(tx_fd, &tx_reg, 1) != 1) {
+                tx_fd = -1;
+            }
+        }
+    }
+    PIR3bits.TX2IF = !tx_full;
+}
+
+static void rx_update(void)
+{
+    ssize_t r;
+    unsigned char c;
+
+    if(rx_waiting) {
+        if(!host_peer_connected() || !PIE3bits.RC2IE) {
+            return;
+        }
+        rx_waiting = FALSE;
+    }
+
+    if(rx_index == rx_buffered && rx_fd >= 0) {
+        r = read(rx_fd, rx_buffer, sizeof(rx_buffer));
+        if(r > 0) {
+            rx_buffered = r;
+            rx_index = 0;
+            if(rx_next < host_time) {
+                /* Line was idle; first character starts now, if RTS allows */
+                rx_next = host_time + sender_character_time();
+                rx_held = LATAbits.LATA3 || rx_xoff;
+            }
+        }
+        else if(r == 0) {
+            /* End of file */
+            rx_fd = -1;
+        }
+    }
+
+    if(rx_held && !LATAbits.LATA3 && !rx_xoff) {
+        /* RTS asserted again, or XON received; next character starts now */
+        rx_held = FALSE;
+        rx_next = host_time + sender_character_time();
+    }
+
+    while(rx_index < rx_buffered && host_time >= rx_next && !rx_held) {
+        /* A character has been received */
+        c = rx_buffer[rx_index];
+        if(escape && (c == SERIAL_XON || c == SERIAL_XOFF || c == SERIAL_ESCAPE)) {
+            /* Sent in two */
+            c = rx_escaping ? c ^ SERIAL_ESCAPE_XOR : SERIAL_ESCAPE;
+            rx_escaping = !rx_escaping;
+        }
+        rx_receive(c);
+        if(!rx_escaping) {
+            rx_index++;
+        }
+        rx_next += sender_character_time();
+        /* RTS is active low; the next character only starts while it's asserted, and
+           not after XOFF */
+        rx_held = LATAbits.LATA3 || rx_xoff;
+    }
+
+    PIR3bits.RC2IF = rx_count > 0;
+}
+
+volatile RCSTAbits_t *host_uart_rcsta(void)
+/*!
+  Access RCSTA2. Clearing CREN resets the receiver, and with that the overrun error;
+  checked on every access, as the firmware sets CREN again right after clearing it.
+  FERR is the framing error of the character at the front of the FIFO
+*/
+{
+    if(!host_rcsta2.CREN) {
+        host_rcsta2.OERR = 0;
+    }
+    host_rcsta2.FERR = rx_count && rx_ferr[0];
+    return &host_rcsta2;
+}
+
+void host_uart_update(void)
+/*!
+  Called whenever time advances
+*/
+{
+    tx_update();
+    rx_update();
+}
+
+unsigned char host_uart_read(void)
+/*!
+  Read RCREG2, taking a character from the receive FIFO
+*/
+{
+    unsigned char c;
+    unsigned long budget;
+
+    c = rx_fifo[0];
+    if(rx_count) {
+        if(rx_armed[0] && host_time - rx_arrival[0] > rx_maxwait) {
+            rx_maxwait = host_time - rx_arrival[0];
+        }
+        /* With the FIFO full, the next character overruns it once it's complete */
+        budget = sizeof(rx_fifo) * character_time();
+        if(!rx_budget || budget < rx_budget) {
+            rx_budget = budget;
+        }
+        rx_fifo[0] = rx_fifo[1];
+        rx_arrival[0] = rx_arrival[1];
+        rx_armed[0] = rx_armed[1];
+        rx_ferr[0] = rx_ferr[1];
+        rx_count--;
+    }
+    PIR3bits.RC2IF = rx_count > 0;
+    host_cycles(HOST_CYCLES_RX_BYTE);
+    return c;
+}
+
+void host_uart_putchar(const unsigned char c)
+/*!
+  Write TXREG2, after waiting for it to become empty
+*/
+{
+    while(tx_full) {
+        host_cycles(tx_shift_done > host_time ? tx_shift_done - host_time : 1);
+    }
+    tx_reg = c;
+    tx_full = TRUE;
+    tx_update();
+}
+
+void host_uart_report(FILE *f)
+{
+    fprintf(f, "UART2: %lu bytes received, %lu lost to overruns, %lu bytes transmitted, %lu XOFFs\n", rx_bytes, rx_overruns, tx_bytes, tx_xoffs);
+    if(rx_framingerrors || rx_autobauds) {
+        fprintf(f, "UART2: %lu framing errors, %lu auto-baud measurements, now at %lu baud\n", rx_framingerrors, rx_autobauds,
+                10 * (HOST_CYCLES_PER_US * 1000000UL) / character_time());
+    }
+    if(rx_budget) {
+        fprintf(f, "UART2: receive interrupt waited at most %llu cycles, %lu allowed; %lu overruns while enabled, %s\n",
+                rx_maxwait, rx_budget, rx_missed, rx_maxwait < rx_budget && !rx_missed ? "within budget" : "OVER BUDGET");
+    }
+}
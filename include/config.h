@@ -39,6 +39,17 @@ Global configuration
 /*! Enable (1) or disable (0) debug output */
 #define DEBUG       1
 
+/*! Enable (1) or disable (0) counting SPI bytes and bus time per subsystem, see ssp.h.
+    That's a 32 bit increment on every transfer, so it's only on by default in the host
+    build; add -DSSP_PROFILE=1 to DEFINES in the Makefile to have it on the board */
+#ifndef SSP_PROFILE
+#ifdef __HOST
+#define SSP_PROFILE 1
+#else
+#define SSP_PROFILE 0
+#endif
+#endif
+
 #ifdef __VISUAL_CODE
 /* To make the Visual Studio Code parser happy.
    Defining these in the c_cpp_properties.json file doesn't work, as they'll be defined with a value (1); we need empty defines here! */
@@ -60,10 +71,15 @@ Global configuration
 #include <pic18.h>
 #endif
 
+#ifdef __HOST
+#include "../host/pic18.h"  // Emulated registers, for running on a PC
+#endif
+
 #include "types.h"
 #include "debug.h"
 #include "../svnrev.h"  // Generated from the Makefile at compile time, defines SVN_REV
 
+#ifndef CLEAR_WATCHDOG
 #if WATCHDOG != 0
 #ifdef __SDCC
 #define CLEAR_WATCHDOG()    do { __asm__ ("clrwdt"); } while(0)
@@ -74,6 +90,7 @@ Global configuration
 #else
 #define CLEAR_WATCHDOG()
 #endif
+#endif
 
 #ifndef RESET
 #ifdef __SDCC
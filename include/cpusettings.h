@@ -104,6 +104,9 @@ CPU configuration (config bits)
 #pragma config IOL1WAY = OFF        //The IOLOCK bit can be set and cleared
 #pragma config MSSP7B_EN = MSK5     //5 bit MSSP address masking mode
 
+#elif defined __HOST
+/* Running on a PC; there are no configuration bits */
+
 #else
 #error Unknown MCU
 #endif
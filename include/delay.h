@@ -31,6 +31,11 @@ void delay_ms(volatile unsigned int time);
 #define delay_ms(x) __delay_ms(x)
 #endif
 
+#ifdef __HOST
+void delay_us(unsigned int time);
+void delay_ms(unsigned int time);
+#endif
+
 void delay_s(volatile unsigned int time);
 
 #endif /* DELAY_H */
@@ -26,10 +26,23 @@ ENC28J60 driver, the definitions
  */
 #define ENC28J60_RX_POLL            1
 
+/* No. of packets that can be queued for transmission; see enc28j60_put_transmit()
+ */
+#define ENC28J60_TXQUEUE_LENGTH     4
+
+/* The controller writes a statusvector of this many bytes right after each
+   transmitted packet */
+#define TXSTATUSVECTORLENGTH        7
+
+/* Receive filters, for frames not sent to our MAC; see enc28j60_setfilter() */
+#define ENC28J60_FILTER_ARP         (1<<0)  /* ARP requests for our IP address, see enc28j60_setaddress() */
+#define ENC28J60_FILTER_DHCP        (1<<1)  /* Replies from DHCP servers */
+
 /* Receive/transmit memory organization; There's 8 KBytes available to divide
    in two for a transmit and a receive buffer.
    Transmitbuffer has room for one full-size packet (NETWORK_MAXPACKETLENGTH
-   with a 7 bytes txstatusvector), receivebuffer gets the rest.
+   with a control byte and a 7 bytes txstatusvector), or a few smaller ones
+   queued back-to-back. Receivebuffer gets the rest.
 
    Keep the RX buffer first (see Erreta rev. B7, note 3), and make sure RXEND
    is an odd value (see Erreta rev. B7, note 14) */
@@ -41,16 +54,29 @@ ENC28J60 driver, the definitions
 #define TXBUFFERLENGTH      (TXEND - TXSTART)
 
 /* Function prototypes */
-bool enc28j60_init(const unsigned char MAC[8]);
+bool enc28j60_init(const unsigned char MAC[6]);
 void enc28j60_setduplex(const bool full);
+void enc28j60_setfilter(const unsigned char filter);
+void enc28j60_setaddress(const unsigned char ipaddr[4]);
 bool enc28j60_link(void);
 void enc28j60_put_transmit(const unsigned short location, const unsigned short length);
-void enc28j60_put_copydata(unsigned char *data, const unsigned short length);
+void enc28j60_put_copydata(const unsigned char *data, const unsigned short length);
 void enc28j60_put_startofpacket(const unsigned short location);
 void enc28j60_put_setwritepointer(const unsigned short location);
 void enc28j60_put_wait(void);
+bool enc28j60_put_queued(const unsigned short location);
+void enc28j60_put(unsigned char *data, const unsigned short length);
+void enc28j60_put_two(const unsigned char *header, const unsigned short headerlength, const unsigned char *data, const unsigned short length);
+bool enc28j60_checksum(const unsigned short location, const unsigned short length, unsigned short *checksum);
+unsigned short enc28j60_checksum_read(const unsigned short location, const unsigned short length);
 unsigned char enc28j60_pendingpackets(void);
-unsigned short enc28j60_get(unsigned char *packetbuffer);
+unsigned short enc28j60_get_header(unsigned char *packetbuffer, unsigned short length);
+void enc28j60_get_rest(unsigned char *packetbuffer);
+unsigned short enc28j60_get_location(const unsigned short offset);
+void enc28j60_get_hold(void);
+void enc28j60_get_done(void);
+unsigned short enc28j60_read(unsigned char *data, const unsigned short location, const unsigned short length);
+void enc28j60_release(void);
 void enc28j60_int(void);
 
 void network_linkchange(void);
@@ -62,13 +88,4 @@ void network_linkchange(void);
                                         INTCON3bits.INT1IE = 1; \
                                     } while (0)
 
-#define enc28j60_put(data, length)  do { \
-                                        enc28j60_put_wait(); \
-                                        enc28j60_int_suspend(); \
-                                        enc28j60_put_startofpacket(TXSTART); \
-                                        enc28j60_put_copydata(data, length); \
-                                        enc28j60_put_transmit(TXSTART, length); \
-                                        enc28j60_int_resume(); \
-                                    } while (0)
-
 #endif /* ENC28J60_H */
@@ -28,7 +28,7 @@ ENC28J60 driver, the definitions
 #define FREEBUFFERLENGTH    (FREEEND - FREESTART)
 
 /* This will transmit the given header-data to the controller at address 'FREESTART + offset',
-   then start a transmission for a packet with a total length of 'header_length + payload_length'.
+   then queue a transmission for a packet with a total length of 'header_length + payload_length'.
    It is thus assumed that the payload of this packet is already in the controller's RAM at
    the right location (that is, right after the header we're copying here) */
 #define enc28j60_put_freebuffer(offset, header, header_length, payload_length) \
@@ -54,6 +54,10 @@ extern unsigned short enc28j60_freebuffer_written;
    20 bytes IPv4 header, 20 bytes TCP header */
 #define TCPIP4_HEADER_LENGTH   (1 + 14 + 20 + 20)
 
+/* No. of bytes for a complete UDP header; 1 controlbyte, 14 bytes Ethernet header, 20 bytes IPv4 header,
+   8 bytes UDP header */
+#define UDPIP4_HEADER_LENGTH   (1 + 14 + 20 + 8)
+
 void enc28j60_put_freebuffer_payload(const unsigned short offset, const unsigned char *payload, const unsigned short payload_length);
 
 #endif /* ENC28J60_FREEBUFFER_H */
\ No newline at end of file
@@ -17,6 +17,14 @@ I/O function definitions and macro's
 #define IO_H
 
 #include "config.h"
+#include "ssp.h"
+
+/* The host build emulates the chips on the SPI busses, these need to know about chip select changes */
+#ifdef __HOST
+#define io_changed()                host_pinchange()
+#else
+#define io_changed()
+#endif
 
 /*
  * Status LED
@@ -43,19 +51,24 @@ I/O function definitions and macro's
  */
  
 #define enc28j60_cs_assert()        do{ \
+                                        ssp_profile_select(SSP_CLASS_ENC28J60_REGISTER); \
                                         LATBbits.LATB3 = 0; \
+                                        io_changed(); \
                                     } while(0)
 
 #define enc28j60_cs_deassert()      do{ \
                                         LATBbits.LATB3 = 1; \
+                                        io_changed(); \
                                     } while(0)
 
 #define enc28j60_reset_assert()     do{ \
                                         LATAbits.LATA1 = 0; \
+                                        io_changed(); \
                                     } while(0)
 
 #define enc28j60_reset_deassert()   do{ \
                                         LATAbits.LATA1 = 1; \
+                                        io_changed(); \
                                     } while(0)
 
 /*
@@ -63,11 +76,14 @@ I/O function definitions and macro's
  */
  
 #define eeprom_cs_assert()          do{ \
+                                        ssp_profile_select(SSP_CLASS_EEPROM); \
                                         LATAbits.LATA6 = 0; \
+                                        io_changed(); \
                                     } while(0)
 
 #define eeprom_cs_deassert()        do{ \
                                         LATAbits.LATA6 = 1; \
+                                        io_changed(); \
                                     } while(0)
 
 /*
@@ -76,10 +92,12 @@ I/O function definitions and macro's
 
 #define sd_cs_assert()              do{ \
                                         LATAbits.LATA7 = 0; \
+                                        io_changed(); \
                                     } while(0)
 
 #define sd_cs_deassert()            do{ \
                                         LATAbits.LATA7 = 1; \
+                                        io_changed(); \
                                     } while(0)
 
 /*
@@ -44,7 +44,16 @@ void serial1_putchar(const unsigned char c);
                                 } while(0)
 
 void serial2_init(void);
+/* Size of the UART2 transmitbuffer; a power of two, at most 256. One entry stays unused */
+#define SERIAL2_TXBUFFER_SIZE   128
 void serial2_putchar(const unsigned char c);
+bool serial2_putready(void);
+unsigned char serial2_txpending(void);
+void serial2_putcontrol(const unsigned char c);
+void serial2_ctsflow(const bool enable);
+void serial2_xoff(const bool off);
+void serial2_txpoll(void);
+void serial2_int_tx(void);
 #define serial2_setbaudrate(x)  do { \
                                     SPBRG2 = x; \
                                     SPBRGH2 = x>>8; \
@@ -55,5 +64,39 @@ void serial2_putchar(const unsigned char c);
 #define serial2_int_resume()    do { \
                                     PIE3bits.RC2IE = 1; \
                                 } while(0)
+/* Auto-baud detection; the baudrate generator measures the next character received, which
+   should be SERIAL_AUTOBAUD_SYNC. That sets RC2IF once it's done, reading RCREG2 clears it
+   but gives no valid character. Nothing should be transmitted meanwhile, the baudrate
+   generator is the counter. With BRG16 and BRGH set it counts at CCLK/32, so over the
+   eight bits it measures it ends up at the number of instruction cycles per bit; one more
+   than the value that gives that baudrate (see settings.h). When the count rolled over,
+   the sender is too slow for it (or held the line low) and the result is no good */
+#define SERIAL_AUTOBAUD_SYNC    0x55
+#define serial2_autobaud_start()    do { \
+                                        BAUDCON2bits.ABDOVF = 0; \
+                                        BAUDCON2bits.ABDEN = 1; \
+                                    } while(0)
+#define serial2_autobaud_busy()     (BAUDCON2bits.ABDEN)
+#define serial2_autobaud_overflow() (BAUDCON2bits.ABDOVF)
+#define serial2_autobaud_result()   ((((unsigned int)SPBRGH2 << 8) | SPBRG2) - 1)
+
+/* XON/XOFF flowcontrol characters. With escaping, those and the escape character itself
+   are sent in the data as SERIAL_ESCAPE followed by the character XOR SERIAL_ESCAPE_XOR */
+#define SERIAL_XON              0x11
+#define SERIAL_XOFF             0x13
+#define SERIAL_ESCAPE           0x7D
+#define SERIAL_ESCAPE_XOR       0x20
+
+/* Timer3 ticks (Fosc/4, 1:8 prescaler) per character time; 10 bits, at the baudrate
+   generator value x (BRG16 and BRGH set, so a bit takes x+1 instruction cycles) */
+#define SERIAL2_IDLETICKS_PER_CHAR(x)   (((unsigned long)(x) + 1) * 10 / 8)
+/* Start measuring an idle period of 'ticks' Timer3 ticks, at most 65535;
+   serial2_idletimer_expired() is TRUE once it's over */
+#define serial2_idletimer_start(ticks)  do { \
+                                            TMR3H = (0x10000 - (ticks)) >> 8; \
+                                            TMR3L = (0x10000 - (ticks)) & 0xFF; \
+                                            PIR2bits.TMR3IF = 0; \
+                                        } while(0)
+#define serial2_idletimer_expired()     (PIR2bits.TMR3IF)
 
 #endif /* _SERIAL_H_ */
@@ -25,8 +25,16 @@ typedef struct settings {
     unsigned char network_gw[4];
     unsigned int network_port;
     unsigned char network_mode;         // TCP, UDP, whatnot -> bitmask
+    unsigned char network_peer[4];      // In UDP mode, seriald sends datagrams here; 0.0.0.0 for whoever sent the last one
+    unsigned int network_peerport;      // ..to this port
     unsigned int serial_baudrate;       // predefined values, 1200, 2400, 4800, and so on, and so forth
     unsigned char serial_mode;          // start and stopbits, parity, flowcontrol
+    unsigned char serial_idlegap;       // seriald sends after the serial line was quiet for this many character times, 0 to disable
+    unsigned int serial_maxlatency;     // ..or when data waited this many milliseconds (10ms resolution), 0 to disable
+    unsigned char serial_minfill;       // ..and moves data to the ethernet controller once this many bytes came in
+    unsigned char serial_delimiter[4];  // seriald sends whole records, ending with these bytes..
+    unsigned char serial_delimiterlength; // ..this many of them (1-4), 0 to disable
+    unsigned char serial_autobaud;      // Measure the baudrate again after this many framing errors, 0 to disable
 } settings_t;
 
 extern settings_t settings;
@@ -38,20 +46,24 @@ extern settings_t settings;
 #define network_mode_udp()              ((settings.network_mode & NETWORK_MODE_TCP) == 0)
 /* Bit 1, */
 
-/* serial_baudrate uses predefined values */
-#if BAUDRATE2_BRG16 != 1 || BAUDRATE2_BRGH != 1 || CCLK != 48000000
-#error Need to recalculate SERIAL_BAUDRATE_ defines for chosen CCLK and BAUDRATE_BRG values
+/* serial_baudrate holds the baudrate generator value. With BRG16 and BRGH set the baudrate
+   is CCLK/(4*(n+1)) (see serial.h); n follows from CCLK, rounded to the nearest value */
+#if BAUDRATE2_BRG16 != 1 || BAUDRATE2_BRGH != 1
+#error SERIAL_BAUDRATE() expects BRG16 and BRGH set
 #endif
-#define SERIAL_BAUDRATE_300             39999
-#define SERIAL_BAUDRATE_1200            9999
-#define SERIAL_BAUDRATE_2400            4999
-#define SERIAL_BAUDRATE_4800            2499
-#define SERIAL_BAUDRATE_9600            1249
-#define SERIAL_BAUDRATE_19200           624
-#define SERIAL_BAUDRATE_38400           312
-#define SERIAL_BAUDRATE_57600           207
-#define SERIAL_BAUDRATE_115200          103
-#define SERIAL_BAUDRATE_230400          51
+#define SERIAL_BAUDRATE(baud)           (((unsigned long)CCLK + 2 * (unsigned long)(baud)) / (4 * (unsigned long)(baud)) - 1)
+#define SERIAL_BAUDRATE_300             SERIAL_BAUDRATE(300)
+#define SERIAL_BAUDRATE_1200            SERIAL_BAUDRATE(1200)
+#define SERIAL_BAUDRATE_2400            SERIAL_BAUDRATE(2400)
+#define SERIAL_BAUDRATE_4800            SERIAL_BAUDRATE(4800)
+#define SERIAL_BAUDRATE_9600            SERIAL_BAUDRATE(9600)
+#define SERIAL_BAUDRATE_19200           SERIAL_BAUDRATE(19200)
+#define SERIAL_BAUDRATE_38400           SERIAL_BAUDRATE(38400)
+#define SERIAL_BAUDRATE_57600           SERIAL_BAUDRATE(57600)
+#define SERIAL_BAUDRATE_115200          SERIAL_BAUDRATE(115200)
+#define SERIAL_BAUDRATE_230400          SERIAL_BAUDRATE(230400)
+#define SERIAL_BAUDRATE_460800          SERIAL_BAUDRATE(460800)
+#define SERIAL_BAUDRATE_921600          SERIAL_BAUDRATE(921600)
 
 /* serial_mode is a bitmask;
    Bit 0-1, flowcontrol */
@@ -74,11 +86,15 @@ extern settings_t settings;
 #define serial_parity_none()            ((settings.serial_mode & SERIAL_MODE_PARITY) == SERIAL_MODE_FLOWCONTROL_NONE)
 #define serial_parity_odd()             ((settings.serial_mode & SERIAL_MODE_PARITY) == SERIAL_MODE_PARITY_ODD)
 #define serial_parity_even()            ((settings.serial_mode & SERIAL_MODE_PARITY) == SERIAL_MODE_PARITY_EVEN)
+/* Bit 5, with XON/XOFF; XON, XOFF and the escape character in the data are escaped, see serial.h */
+#define SERIAL_MODE_ESCAPE              (1<<5)
+#define serial_flowcontrol_escaped()    (serial_flowcontrol_xonxoff() && (settings.serial_mode & SERIAL_MODE_ESCAPE))
 
 void settings_init(void);
 bool settings_load(void);
 void settings_default(void);
 bool settings_store(void);
+bool settings_storebaudrate(void);
 bool settings_usedhcp(void);
 void settings_loadnetworkparameters(unsigned char ip[4], unsigned char mask[4], unsigned char gw[4]);
 
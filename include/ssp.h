@@ -18,9 +18,64 @@ On-chip SSP access function definitions
 
 #include "config.h"
 
+/* SPI bus profiling. Every byte moved over SSP1 is counted against the SD card, every byte
+   over SSP2 against the class selected with ssp_profile_select(); the chip select macros in
+   io.h select the chip, the ENC28J60 driver switches to the buffer class for RBM/WBM data.
+   Bus time is in instruction cycles, following the SPI clock set at that moment */
+#define SSP_CLASS_ENC28J60_REGISTER     0
+#define SSP_CLASS_ENC28J60_BUFFER       1
+#define SSP_CLASS_EEPROM                2
+#define SSP_CLASS_SD                    3
+#define SSP_CLASSES                     4
+
+typedef struct {
+    unsigned long bytes;
+    unsigned long cycles;
+} ssp_profile_t;
+
+#if SSP_PROFILE
+extern ssp_profile_t ssp_profile[SSP_CLASSES];
+extern unsigned char ssp_profile_class;
+
+#define ssp_profile_select(class)   do { \
+                                        ssp_profile_class = (class); \
+                                    } while(0)
+/* Instruction cycles per byte for the SSPM bits in SSPxCON1; Fosc/4 is one cycle per SPI clock */
+#define ssp_profile_cycles(sspcon1) (((sspcon1) & 0x0F) == 0x00 ? 8 : \
+                                     ((sspcon1) & 0x0F) == 0x0A ? 16 : \
+                                     ((sspcon1) & 0x0F) == 0x01 ? 32 : 128)
+#define ssp_profile_count(class, sspcon1) do { \
+                                        ssp_profile[class].bytes++; \
+                                        ssp_profile[class].cycles += ssp_profile_cycles(sspcon1); \
+                                    } while(0)
+#define ssp_profile_count_block(class, sspcon1, length) do { \
+                                        ssp_profile[class].bytes += (length); \
+                                        ssp_profile[class].cycles += (unsigned long)(length) * ssp_profile_cycles(sspcon1); \
+                                    } while(0)
+void ssp_profile_reset(void);
+#else
+#define ssp_profile_select(class)
+#define ssp_profile_count(class, sspcon1)
+#define ssp_profile_count_block(class, sspcon1, length)
+#define ssp_profile_reset()
+#endif
+
+/* SPI DMA; the 18F27J53 can move blocks over MSSP1 without the CPU. It's not there on MSSP2,
+   and we don't use it on the other supported CPU's; ssp1_write_block() and ssp1_read_block()
+   fall back to a byte loop then */
+#if defined(__SDCC_PIC18F27J53) || defined (__18F27J53)
+#define SSP1_DMA            1
+#else
+#define SSP1_DMA            0
+#endif
+/* DMABC is 10 bits, holding the byte count minus one */
+#define SSP1_DMA_MAXLENGTH  1024
+
 void ssp1_init(void);
 bool ssp1_put(unsigned char x);
 unsigned char ssp1_get(void);
+void ssp1_write_block(const unsigned char *data, unsigned short length);
+void ssp1_read_block(unsigned char *data, unsigned short length);
 /* Clock = Fosc/4 */
 #define ssp1_clock_4()  do { \
                             SSP1CON1 &= ~0x0F; \
@@ -44,6 +99,8 @@ unsigned char ssp1_get(void);
 void ssp2_init(void);
 bool ssp2_put(unsigned char x);
 unsigned char ssp2_get(void);
+void ssp2_write_block(const unsigned char *data, unsigned short length);
+void ssp2_read_block(unsigned char *data, unsigned short length);
 /* Clock = Fosc/4 */
 #define ssp2_clock_4()  do { \
                             SSP2CON1 &= ~0x0F; \
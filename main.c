@@ -43,10 +43,34 @@ Main code
 
 /* Uptime in minutes, increased in the RTC minute interrupt handler */
 unsigned long system_uptime;
+/* System ticks, increased every 10ms in systick(); wraps around */
+volatile unsigned char system_ticks;
 
-static bool uip_periodic, uip_periodicarp;
+static bool uip_fastperiodic, uip_periodic, uip_periodicarp;
 
 #define BUF ((struct uip_eth_hdr *)&uip_buf[0])
+#define TCPIPBUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_URG 0x20
+
+/* Payload for seriald that's left in the ethernet controller until it's out on UART2;
+   see seriald_received() and seriald_drain() */
+static bool received_incontroller;
+static unsigned short received_location, received_length;
+static unsigned char received_buffer[16];
+static unsigned char received_pointer, received_count;
+/* seriald received data since the receive windows were last opened again */
+static bool received_any;
+
+/* seriald stops receiving while the UART2 transmitbuffer holds more than this */
+#define RECEIVED_TXPENDING_MAX  (SERIAL2_TXBUFFER_SIZE / 2)
+
+static bool network_payload_incontroller(void);
+static unsigned short network_checksum(const unsigned short location, const unsigned short length);
+static void seriald_putchar(const unsigned char c);
+static void seriald_drain(void);
 
 FATFS fatfs;
 
@@ -92,7 +116,7 @@ static inline void init(void)
         5       o       TX
         6       o       /CS_EEPROM
         7       o       /CS_SD  */
-    LATA = 0xE1;                // INT and CS_* are active low, TX is high when idle. We actually assert RESET here!
+    LATA = 0xE9;                // INT, RTS and CS_* are active low, TX is high when idle. We actually assert RESET here!
     TRISA = 0x15;               // Set = input, clear = output
 
     /* PORT B I/O usage:
@@ -204,6 +228,11 @@ static void systick(void)
     static unsigned char uipcounter=0;
     static unsigned char uiparpcounter=0;
 
+    system_ticks++;
+
+    /* TCP retransmission timers, UIP_FAST_TIMER_INTERVAL */
+    uip_fastperiodic = TRUE;
+
     uipcounter++;
     if(uipcounter == 50) {
         uipcounter = 0;
@@ -233,7 +262,11 @@ unsigned int ticks(void)
 
 extern int crctest(void);
 
+#ifdef __HOST
+void piconet_main(void)
+#else
 void main(void)
+#endif
 /*!
   Startpoint of C-code
 */
@@ -247,6 +280,10 @@ void main(void)
 
     unsigned char mac[6];
     unsigned char i;
+    struct uip_conn *conn;
+    #if UIP_UDP
+    struct uip_udp_conn *udpconn;
+    #endif
 
     FRESULT ffres;
 
@@ -263,6 +300,9 @@ void main(void)
     #ifdef __XC8
     dprint("Build %s, %s with XC8 version %d\n\r", __DATE__,__TIME__, __XC8_VERSION);
     #endif
+    #ifdef __HOST
+    dprint("Build %s, %s for the host\n\r", __DATE__, __TIME__);
+    #endif
 
     /* Initialize Ethernet controller hardware */
     if(eeprom_25aa02e48_getEUI48(mac)) {
@@ -286,6 +326,7 @@ void main(void)
     serial2_int_suspend();
 
     /* Setup network stack */
+    uip_fastperiodic = FALSE;
     uip_periodic = FALSE;
     uip_periodicarp = FALSE;
     uip_setethaddr(mac);
@@ -371,8 +412,14 @@ void main(void)
 
         /* Incoming data from the network controller */
         while(enc28j60_pendingpackets()) {
-            /* Read new packet from the ethernet controller */
-            if((uip_len = enc28j60_get(uip_buf))) {
+            /* Read the headers of a new packet from the ethernet controller.. */
+            if((uip_len = enc28j60_get_header(uip_buf, UIP_LLH_LEN + UIP_IPTCPH_LEN))) {
+                /* ..and the rest, unless it's seriald payload that can stay there */
+                uip_incontroller_rx = network_payload_incontroller();
+                if(!uip_incontroller_rx) {
+                    enc28j60_get_rest(uip_buf);
+                }
+
                 /* And let the network stack do it's magic */
                 if(BUF->type == htons(UIP_ETHTYPE_IP)) {
                     uip_input();
@@ -387,17 +434,66 @@ void main(void)
                         uip_output();
                     }
                 }
+                uip_incontroller_rx = FALSE;
             }
+            enc28j60_get_done();
         }
 
-        if(seriald_shouldtransfer()) {
-            serial2_int_suspend();
-            seriald_switchbuffers();
-            serial2_int_resume();
+        /* UART2 output that waits for CTS */
+        serial2_txpoll();
 
+        /* Received seriald data that's still in the ethernet controller */
+        if(received_incontroller) {
+            seriald_drain();
+        }
+        if(received_any && !seriald_receivebusy()) {
+            /* Received data is out of the controller, and UART2 is catching up; let seriald
+               open its receive window again */
+            received_any = FALSE;
+            for(i = 0; i < UIP_CONNS; i++) {
+                if(uip_stopped(&uip_conns[i])) {
+                    uip_poll_conn(&uip_conns[i]);
+                    if(uip_len > 0) {
+                        uip_arp_out();
+                        uip_split_output();
+                    }
+                }
+            }
+        }
+
+        if(seriald_shouldtransfer()) {
             seriald_transfer();
         }
+        /* Serial data that shouldn't wait for the next periodic poll */
+        if((conn = seriald_flush()) != NULL) {
+            uip_poll_conn(conn);
+            if(uip_len > 0) {
+                uip_arp_out();
+                uip_split_output();
+            }
+        }
+        #if UIP_UDP
+        if((udpconn = seriald_udpflush()) != NULL) {
+            uip_udp_periodic_conn(udpconn);
+            if(uip_len > 0) {
+                uip_arp_out();
+                uip_split_output();
+            }
+        }
+        #endif
         
+        /* Retransmissions, every 10 ms */
+        if(uip_fastperiodic) {
+            uip_fastperiodic = FALSE;
+            for(i = 0; i < UIP_CONNS; i++) {
+                uip_fastperiodic(i);
+                if(uip_len > 0) {
+                    uip_arp_out();
+                    uip_split_output();
+                }
+            }
+        }
+
         /* Periodic network tasks */
         if(uip_periodic) {
             /* Once every 1/2 second */
@@ -414,7 +510,7 @@ void main(void)
                 uip_udp_periodic(i);
                 if(uip_len > 0) {
                     uip_arp_out();
-                    uip_output();
+                    uip_split_output();
                 }
             }
             #endif
@@ -467,6 +563,19 @@ void network_dhcpupdate(dhcp_parameters_t *parameters)
         settings_loadnetworkparameters(parameters->ipaddr, parameters->netmask, parameters->router);       
     }
 }
+
+void network_dhcpwait(const bool waiting)
+/*!
+  DHCP client starts or stops waiting for a reply from a server
+*/
+{
+    if(waiting) {
+        enc28j60_setfilter(ENC28J60_FILTER_ARP | ENC28J60_FILTER_DHCP);
+    }
+    else {
+        enc28j60_setfilter(ENC28J60_FILTER_ARP);
+    }
+}
 #endif
 
 void uip_output(void)
@@ -474,16 +583,91 @@ void uip_output(void)
     enc28j60_put(uip_buf, uip_len);
 }
 
+void uip_output_payload(const u8_t *payload, const u16_t payload_length)
+{
+    enc28j60_put_two(uip_buf, UIP_LLH_LEN + UIP_TCPIP_HLEN, payload, payload_length);
+}
+
 void uip_output_incontroller(const u16_t offset, const u8_t header_length, const u16_t payload_length)
 {
     enc28j60_put_freebuffer(offset, uip_buf, header_length, payload_length);
 }
 
+u16_t uip_chksum_incontroller(const u16_t offset, const u16_t length)
+{
+    return network_checksum(FREESTART + offset, length);
+}
+
+u16_t uip_chksum_incontroller_rx(const u16_t length)
+{
+    return network_checksum(enc28j60_get_location(UIP_LLH_LEN + UIP_IPTCPH_LEN), length);
+}
+
+static unsigned short network_checksum(const unsigned short location, const unsigned short length)
+/*!
+  Checksum over data in the ethernet controller, with its DMA engine. That's tried once
+  more when a packet came in meanwhile (see enc28j60_checksum()); then the data is read
+  and added up instead
+*/
+{
+    unsigned short checksum;
+
+    if(enc28j60_checksum(location, length, &checksum) || enc28j60_checksum(location, length, &checksum)) {
+        return checksum;
+    }
+    return enc28j60_checksum_read(location, length);
+}
+
+static bool network_payload_incontroller(void)
+/*!
+  Can the payload of the packet of which uip_buf holds the headers stay in the ethernet
+  controller? Only for a plain TCP segment, without IP or TCP options or urgent data,
+  that has the next data for an established seriald connection. Anything else (a
+  duplicate, a segment out of order, a SYN, FIN or RST) gets an answer from uIP that
+  doesn't involve the payload, and the payload can't be left where that answer goes
+*/
+{
+    unsigned char i;
+    struct uip_conn *conn;
+
+    if(!network_mode_tcp() || uip_len < UIP_LLH_LEN + UIP_IPTCPH_LEN) {
+        return FALSE;
+    }
+    if(BUF->type != htons(UIP_ETHTYPE_IP) || TCPIPBUF->vhl != 0x45 || TCPIPBUF->proto != UIP_PROTO_TCP) {
+        return FALSE;
+    }
+    if(TCPIPBUF->destport != htons(settings.network_port) || TCPIPBUF->tcpoffset != 0x50 ||
+       (TCPIPBUF->flags & (TCP_URG | TCP_RST | TCP_SYN | TCP_FIN))) {
+        return FALSE;
+    }
+    /* There should be payload, all of it in this frame.. */
+    if(((TCPIPBUF->len[0] << 8) | TCPIPBUF->len[1]) <= UIP_IPTCPH_LEN ||
+       ((TCPIPBUF->len[0] << 8) | TCPIPBUF->len[1]) > uip_len - UIP_LLH_LEN) {
+        return FALSE;
+    }
+    /* ..and it should be what the connection expects next */
+    for(i = 0; i < UIP_CONNS; i++) {
+        conn = &uip_conns[i];
+        if(conn->tcpstateflags == UIP_ESTABLISHED &&
+           conn->lport == TCPIPBUF->destport && conn->rport == TCPIPBUF->srcport &&
+           uip_ipaddr_cmp(conn->ripaddr, TCPIPBUF->srcipaddr)) {
+            return conn->rcv_nxt[0] == TCPIPBUF->seqno[0] && conn->rcv_nxt[1] == TCPIPBUF->seqno[1] &&
+                   conn->rcv_nxt[2] == TCPIPBUF->seqno[2] && conn->rcv_nxt[3] == TCPIPBUF->seqno[3];
+        }
+    }
+    return FALSE;
+}
+
 void seriald_connected(void)
 /*!
   uIP seriald application has a client
 */
 {
+    if(RCSTA2bits.OERR) {
+        /* The receiver overran while nobody listened; that data isn't wanted anyway */
+        RCSTA2bits.CREN = 0;
+        RCSTA2bits.CREN = 1;
+    }
     serial2_int_resume();
 }
 
@@ -497,13 +681,93 @@ void seriald_disconnected(void)
 
 void seriald_received(const char *data, const unsigned int length)
 /*
-  uIP seriald application received data
+  uIP seriald application received data. When 'data' is NULL, it's still in the ethernet
+  controller. What doesn't fit in the UART2 transmitbuffer right away is kept there, and
+  sent out from the main loop (see seriald_drain())
 */
 {
+    extern seriald_statistics_t seriald_statistics;
     unsigned int i;
+    unsigned short offset;
+
+    received_any = TRUE;
+    if(received_incontroller) {
+        /* Over UDP nothing stops the sender while an earlier datagram is kept */
+        seriald_statistics.serial_dropped += length;
+        return;
+    }
 
-    for(i=0;i<length;i++) {
-        serial2_putchar(data[i]);
+    i = 0;
+    if(data == NULL) {
+        offset = UIP_LLH_LEN + UIP_IPTCPH_LEN;
+    }
+    else {
+        /* Room for a byte, escaped */
+        while(i < length && serial2_txpending() < SERIAL2_TXBUFFER_SIZE - 2) {
+            seriald_putchar(data[i]);
+            i++;
+        }
+        if(i == length) {
+            return;
+        }
+        /* The rest is still in the ethernet controller too */
+        offset = (const unsigned char *)data - uip_buf + i;
+    }
+
+    /* seriald stops receiving until we're done with this, see seriald_receivebusy() */
+    received_location = enc28j60_get_location(offset);
+    received_length = length - i;
+    received_incontroller = TRUE;
+    enc28j60_get_hold();
+}
+
+static void seriald_putchar(const unsigned char c)
+/*!
+  Send a byte of received seriald data out on UART2; escaped, when XON/XOFF are (see
+  serial.h)
+*/
+{
+    if(serial_flowcontrol_escaped() && (c == SERIAL_XON || c == SERIAL_XOFF || c == SERIAL_ESCAPE)) {
+        serial2_putchar(SERIAL_ESCAPE);
+        serial2_putchar(c ^ SERIAL_ESCAPE_XOR);
+    }
+    else {
+        serial2_putchar(c);
+    }
+}
+
+bool seriald_receivebusy(void)
+/*!
+  Is received data still waiting in the ethernet controller, or filling up the UART2
+  transmitbuffer?
+*/
+{
+    return received_incontroller || serial2_txpending() > RECEIVED_TXPENDING_MAX;
+}
+
+static void seriald_drain(void)
+/*!
+  Move data that seriald_received() left in the ethernet controller to the UART2
+  transmitbuffer, as far as it goes without waiting. Frees the controller memory once it's
+  all out
+*/
+{
+    /* Room for a byte, escaped */
+    while(serial2_txpending() < SERIAL2_TXBUFFER_SIZE - 2) {
+        if(received_pointer == received_count) {
+            if(received_length == 0) {
+                enc28j60_release();
+                received_incontroller = FALSE;
+                return;
+            }
+            /* Fetch the next few bytes */
+            received_count = received_length < sizeof(received_buffer) ? received_length : sizeof(received_buffer);
+            received_location = enc28j60_read(received_buffer, received_location, received_count);
+            received_length -= received_count;
+            received_pointer = 0;
+        }
+        seriald_putchar(received_buffer[received_pointer]);
+        received_pointer++;
     }
 }
 
@@ -521,6 +785,9 @@ void putchar (char c) __wparam
 #ifdef __XC8
 void putch(char c)
 #endif
+#ifdef __HOST
+void putch(char c)
+#endif
 /*!
   This function is called by printf to print a character
 */
@@ -534,26 +801,16 @@ void isr_high(void) __interrupt 1
 #ifdef __XC8
 void high_priority interrupt isr_high(void)
 #endif
+#ifdef __HOST
+void isr_high(void)
+#endif
 /*!
   High priority interrupts
 */
 {
-    unsigned char clear;
-
-    /* UART2 */
-    if(RCSTA2bits.OERR) {
-        /* Overrun error. Clear by toggeling RCSTA.CREN */
-        RCSTA2bits.CREN = 0;
-        RCSTA2bits.CREN = 1;
-        seriald_dropped();
-    }
-    else if(RCSTA2bits.FERR) {
-        /* Framing error. Clear by reading RCREG */
-        clear = RCREG2;
-    }
-    else {
-        seriald_incoming(RCREG2);
-    }
+    /* UART2; it's the only one, so no need to check the flag. Nothing else runs at this
+       priority, and it preempts the low priority interrupt, SPI and all */
+    seriald_int_rx();
 }
 
 #ifdef __SDCC
@@ -562,6 +819,9 @@ void isr_low(void) __interrupt 2
 #ifdef __XC8
 void low_priority interrupt isr_low(void)
 #endif
+#ifdef __HOST
+void isr_low(void)
+#endif
 /*!
   Low priority interrupts
 */
@@ -578,6 +838,10 @@ void low_priority interrupt isr_low(void)
         TMR1L = 5536&0xFF;
         systick();
     }
+    else if(PIR3bits.TX2IF && PIE3bits.TX2IE) {
+        /* UART2 can take the next character */
+        serial2_int_tx();
+    }
     else if(PIR3bits.RTCCIF) {
         /* RTC, setup for one interrupt per minute */
         system_uptime++;
@@ -26,8 +26,10 @@ SD-card SPI driver
 /* Which ssp interface to use? */
 #define sdspi_put(data)     ssp1_put(data)
 #define sdspi_get()         ssp1_get()
-#define sdspi_slow()        ssp2_clock_64()
-#define sdspi_fast()        ssp2_clock_4()
+#define sdspi_write_block(data, length) ssp1_write_block(data, length)
+#define sdspi_read_block(data, length)  ssp1_read_block(data, length)
+#define sdspi_slow()        ssp1_clock_64()
+#define sdspi_fast()        ssp1_clock_4()
 
 cardinfo_t cardinfo;
 
@@ -290,8 +292,6 @@ static bool sd_getregister(unsigned char command, unsigned char *buffer)
   Read a 16 bytes register (CID or CSD) from the SD card
 */
 {
-    char i;
-
     /* Send initial command */
     if(sd_put(command,0,0xFF)!=0) {
         return FALSE;
@@ -302,10 +302,7 @@ static bool sd_getregister(unsigned char command, unsigned char *buffer)
     }
 
     /* Read the the register */
-    for(i=0;i<16;i++) {
-        *buffer = sdspi_get();
-        buffer++;
-    }
+    sdspi_read_block(buffer, 16);
 
     sdspi_put(0xFF);
 
@@ -345,7 +342,7 @@ bool sd_readsectors(unsigned long startsector, unsigned char sectorcount, unsign
   Read one or more sectors from the SD card, and store it in 'buffer'
 */
 {
-    unsigned short i, j;
+    unsigned short j;
     unsigned long sector;
     
     if(cardinfo.type == CARDTYPE_SDV2_BLOCKADDRESSING) {
@@ -378,9 +375,8 @@ bool sd_readsectors(unsigned long startsector, unsigned char sectorcount, unsign
 
     /* And read data */
     for(j=0;j<sectorcount;j++) {
-        for(i=0;i<512;i++) {
-            buffer[i] = sdspi_get();
-        }
+        sdspi_read_block(buffer, 512);
+        buffer += 512;
         /* Close transfer by reading the two byte CRC (and futher ignoring it's value) */
         sdspi_put(0xFF);
         sdspi_put(0xFF);
@@ -407,7 +403,7 @@ bool sd_writesectors(unsigned long startsector, unsigned char sectorcount, const
   Write one or more sectors to the SD card, read data from 'buffer'
 */
 {
-    unsigned short i, j;    
+    unsigned short j;    
     unsigned long sector;
     
     if(cardinfo.type == CARDTYPE_SDV2_BLOCKADDRESSING) {
@@ -444,9 +440,8 @@ bool sd_writesectors(unsigned long startsector, unsigned char sectorcount, const
 
     /* write data */
     for(j=0;j<sectorcount;j++) {
-        for(i=0;i<512;i++) {
-            sdspi_put(buffer[i]);
-        }
+        sdspi_write_block(buffer, 512);
+        buffer += 512;
         /* Close transfer by sending dummy CRC */
         sdspi_put(0xFF);
         sdspi_put(0xFF);
@@ -14,8 +14,26 @@
 On-chip UART2 access
 */
 #include "serial.h"
+#include "io.h"
 #include "delay.h"
 
+/* Transmitbuffer, drained by the TX2 interrupt (see serial2_int_tx()). serial2_putchar()
+   moves the head, the interrupt the tail */
+static unsigned char txbuffer[SERIAL2_TXBUFFER_SIZE];
+static volatile unsigned char txhead, txtail;
+
+/* Flowcontrol. With RTS/CTS nothing goes out while CTS is deasserted (high, as RTS), with
+   XON/XOFF nothing goes out after the other side sent XOFF; the interrupt stops,
+   serial2_txpoll() and serial2_xoff() start it again. A control character of our own goes
+   out ahead of the transmitbuffer, see serial2_putcontrol(). Transmission is
+   held during auto-baud detection as well */
+static volatile bool ctsflow;
+static volatile bool xoff;
+static volatile unsigned char txcontrol;        /* 0 when there's none */
+
+#define TXNEXT(x)   (((x) + 1) & (SERIAL2_TXBUFFER_SIZE - 1))
+#define stopped()   ((ctsflow && serial_cts()) || xoff || serial2_autobaud_busy())
+
 void serial2_init(void)
 /*!
   Configure UART2
@@ -38,7 +56,8 @@ void serial2_init(void)
     RCSTA2bits.ADDEN = 0; // Disable address detection
 
     /* Interrupts */
-    PIE3bits.TX2IE = 0;   // USART Transmit Interupt Enable Bit: 0 = disabled
+    PIE3bits.TX2IE = 0;   // USART Transmit Interupt Enable Bit: 0 = disabled, until there's something to send
+    IPR3bits.TX2IP = 0;   // Low priority
     PIE3bits.RC2IE = 1;   // USART Receive Interupt Enable Bit: 1 = enabled
     IPR3bits.RC2IP = 1;   // High priority
 
@@ -49,7 +68,7 @@ void serial2_init(void)
     BAUDCON2bits.BRG16 = 0; // 16 bit baudrate generator
 #endif
     BAUDCON2bits.WUE = 0;   // RX pin wakeup disabled
-    BAUDCON2bits.ABDEN = 0; // baudrate measurment disabled
+    BAUDCON2bits.ABDEN = 0; // baudrate measurment disabled, until serial2_autobaud_start()
 
     /* Set baudrate (see config.h) */
     SPBRG2 = BAUDRATE2&0xFF;
@@ -57,15 +76,144 @@ void serial2_init(void)
 
     /* And enable serial port */
     RCSTA2bits.SPEN = 1;
+
+    /* Timer3 measures how long the receiver is idle, see serial2_idletimer_start().
+       Using Fosc/4 as clock with an 1:8 prescaler means a timer-increment each 0.667uS.
+       No interrupt; the overflow flag is polled */
+    T3CONbits.RD16 = 1;         // Read/write timer as one 16 bits value
+    T3CONbits.T3CKPS1 = 1;      // Use a 1:8 prescaler
+    T3CONbits.T3CKPS0 = 1;
+    T3CONbits.T3OSCEN = 0;      // Disable timer3 oscillator
+    T3CONbits.TMR3CS0 = 0;      // Use instruction clock..
+    T3CONbits.TMR3CS1 = 0;      // ..as source
+    T3CONbits.TMR3ON = 1;       // Start timer
 }
 
-void serial2_putchar(const unsigned char c)
+static void transmit(const unsigned char c)
 /*!
-  Send a character on UART2
+  Write a character to TXREG2
 */
 {
+#ifdef __HOST
+    host_uart_putchar(c);
+#else
     /* Wait untill TXREG has room */
     while(PIR3bits.TX2IF==0);
     /* Write character, this clears TXIF */
     TXREG2 = c;
+#endif
+}
+
+void serial2_putchar(const unsigned char c)
+/*!
+  Queue a character for UART2. When the transmitbuffer is full, this waits for the TX2
+  interrupt to take one. Within the low priority interrupt (dprint()) that interrupt can't
+  run, GIEL is cleared there; the character is transmitted directly then, the high priority
+  interrupt may enable TX2IE meanwhile but serial2_int_tx() won't run before we're done.
+  Not reentrant; don't call it from both at once. The character is dropped when there's no
+  room while flowcontrol holds transmission, that could take forever (nothing connected)
+*/
+{
+    if(TXNEXT(txhead) == txtail) {
+        if(INTCONbits.GIEL) {
+            while(TXNEXT(txhead) == txtail) {
+                if(stopped()) {
+                    return;
+                }
+                PIE3bits.TX2IE = 1;
+#ifdef __HOST
+                host_cycles(1);
+#endif
+            }
+        }
+        else {
+            if(stopped()) {
+                return;
+            }
+            transmit(txbuffer[txtail]);
+            txtail = TXNEXT(txtail);
+        }
+    }
+    txbuffer[txhead] = c;
+    txhead = TXNEXT(txhead);
+    PIE3bits.TX2IE = 1;
+}
+
+bool serial2_putready(void)
+/*!
+  TRUE when serial2_putchar() won't have to wait
+*/
+{
+    return TXNEXT(txhead) != txtail;
+}
+
+unsigned char serial2_txpending(void)
+/*!
+  Number of characters in the transmitbuffer
+*/
+{
+    return (txhead - txtail) & (SERIAL2_TXBUFFER_SIZE - 1);
+}
+
+void serial2_putcontrol(const unsigned char c)
+/*!
+  Send a flowcontrol character (XON, XOFF) as soon as UART2 can take it, ahead of what's
+  in the transmitbuffer and even while transmission is held. Also called from the high
+  priority interrupt
+*/
+{
+    txcontrol = c;
+    PIE3bits.TX2IE = 1;
+}
+
+void serial2_ctsflow(const bool enable)
+/*!
+  Hold transmission while CTS is deasserted, or not
+*/
+{
+    ctsflow = enable;
+    serial2_txpoll();
+}
+
+void serial2_xoff(const bool off)
+/*!
+  The other side sent XOFF (hold transmission) or XON. Called from the high priority
+  interrupt
+*/
+{
+    xoff = off;
+    if(!off) {
+        PIE3bits.TX2IE = 1;
+    }
+}
+
+void serial2_txpoll(void)
+/*!
+  CTS doesn't interrupt; call this from the main loop to continue once it's asserted again,
+  or auto-baud detection is done
+*/
+{
+    if(txcontrol || (txtail != txhead && !stopped())) {
+        PIE3bits.TX2IE = 1;
+    }
+}
+
+void serial2_int_tx(void)
+/*!
+  TX2 interrupt; TXREG2 has room for the next character
+*/
+{
+    if(txcontrol && !serial2_autobaud_busy()) {
+        transmit(txcontrol);
+        txcontrol = 0;
+        return;
+    }
+    if(txtail == txhead || stopped()) {
+        /* Transmitbuffer is empty, nothing to wait for until serial2_putchar(). Or the
+           other side isn't ready; serial2_txpoll(), serial2_xoff() */
+        PIE3bits.TX2IE = 0;
+        return;
+    }
+    transmit(txbuffer[txtail]);
+    txtail = TXNEXT(txtail);
 }
@@ -16,6 +16,8 @@ Piconet settings
 #include "settings.h"
 #include "25aa02e48.h"
 #include "uip.h"
+#include "uip_split.h"
+#include "enc28j60.h"
 
 settings_t settings;
 
@@ -56,6 +58,9 @@ void settings_default(void)
     }
     /* Load some defaults */
     settings.serial_baudrate = SERIAL_BAUDRATE_9600;
+    settings.serial_idlegap = 4;
+    settings.serial_maxlatency = 50;
+    settings.serial_minfill = 128;
 }
 
 bool settings_store(void)
@@ -82,6 +87,38 @@ bool settings_store(void)
     return FALSE;
 }
 
+bool settings_storebaudrate(void)
+{
+    unsigned char checksum = 0;
+    unsigned char i, offset;
+
+    /* Only on top of good settings; those may differ from what's in RAM, which isn't saved yet */
+    for(i=0;i<sizeof(settings);i++) {
+        checksum += eeprom_25aa02e48_readbyte(i);
+    }
+    if(eeprom_25aa02e48_readbyte(i) != checksum) {
+        return FALSE;
+    }
+
+    offset = (unsigned char *)&settings.serial_baudrate - (unsigned char *)&settings;
+    for(i=offset;i<offset+sizeof(settings.serial_baudrate);i++) {
+        if(eeprom_25aa02e48_readbyte(i) != ((unsigned char *)&settings)[i]) {
+            checksum += ((unsigned char *)&settings)[i] - eeprom_25aa02e48_readbyte(i);
+            if(eeprom_25aa02e48_writebyte(i, ((unsigned char *)&settings)[i]) == FALSE) {
+                /* Could not write byte */
+                return FALSE;
+            }
+        }
+    }
+
+    /* Update checksum */
+    if(eeprom_25aa02e48_readbyte(sizeof(settings)) == checksum || eeprom_25aa02e48_writebyte(sizeof(settings), checksum)) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 bool settings_usedhcp(void)
 {
     return settings.network_ip[0] == 0 && settings.network_ip[1] == 0 && settings.network_ip[2] == 0 && settings.network_ip[3] == 0;
@@ -103,8 +140,13 @@ void settings_loadnetworkparameters(unsigned char ip[4], unsigned char mask[4],
    
     uip_ipaddr(ipaddr, ip[0], ip[1], ip[2], ip[3]);
     uip_sethostaddr(ipaddr);
+    /* Header templates have the old address in them */
+    uip_split_forget();
     uip_ipaddr(ipaddr, mask[0], mask[1], mask[2], mask[3]);
     uip_setnetmask(ipaddr);
     uip_ipaddr(ipaddr, gw[0], gw[1], gw[2], gw[3]);
     uip_setdraddr(ipaddr);
+
+    /* Let the ARP requests for our new address in */
+    enc28j60_setaddress(ip);
 }
\ No newline at end of file
@@ -16,6 +16,67 @@ On-chip SSP1 access
 #include "ssp.h"
 #include "delay.h"
 
+#if SSP_PROFILE
+/* Profiling counters, for both SSP's */
+ssp_profile_t ssp_profile[SSP_CLASSES];
+unsigned char ssp_profile_class;
+
+void ssp_profile_reset(void)
+/*!
+  Clear all profiling counters
+*/
+{
+    unsigned char i;
+
+    for(i=0;i<SSP_CLASSES;i++) {
+        ssp_profile[i].bytes = 0;
+        ssp_profile[i].cycles = 0;
+    }
+}
+#endif
+
+#if SSP1_DMA
+/* Sent while receiving with the SPI DMA module; it has to be in RAM */
+static unsigned char ssp1_dma_idle = 0xFF;
+
+static void ssp1_dma(const unsigned char *tx, unsigned char *rx, unsigned short length)
+/*!
+  Move 'length' bytes with the SPI DMA module; transmit only from 'tx' when 'rx' is NULL,
+  otherwise full duplex into 'rx' while sending 0xFF's. Waits until it's done
+*/
+{
+    unsigned short chunk;
+    unsigned char x;
+
+    while(length) {
+        chunk = length > SSP1_DMA_MAXLENGTH ? SSP1_DMA_MAXLENGTH : length;
+        DMABCH = ((chunk - 1) >> 8) & 0x03;
+        DMABCL = (chunk - 1) & 0xFF;
+        if(rx) {
+            TXADDRH = ((unsigned short)&ssp1_dma_idle >> 8) & 0x0F;
+            TXADDRL = (unsigned short)&ssp1_dma_idle & 0xFF;
+            RXADDRH = ((unsigned short)rx >> 8) & 0x0F;
+            RXADDRL = (unsigned short)rx & 0xFF;
+            DMACON1 = 0x18;     // RXINC=1, TXINC=0; full duplex, the same 0xFF goes out for every byte
+            rx += chunk;
+        }
+        else {
+            TXADDRH = ((unsigned short)tx >> 8) & 0x0F;
+            TXADDRL = (unsigned short)tx & 0xFF;
+            DMACON1 = 0x24;     // TXINC=1; half duplex, transmit only
+            tx += chunk;
+        }
+        DMACON2 = 0;            // No delay between bytes
+        DMACON1bits.DMAEN = 1;  // Go..
+        while(DMACON1bits.DMAEN);
+        length -= chunk;
+    }
+
+    /* Leave BF clear for ssp1_get() */
+    x = SSP1BUF;
+}
+#endif
+
 void ssp1_init(void)
 /*!
   Configure SSP1
@@ -35,6 +96,11 @@ void ssp1_init(void)
 
 bool ssp1_put(unsigned char x)
 {
+    ssp_profile_count(SSP_CLASS_SD, SSP1CON1);
+#ifdef __HOST
+    SSP1BUF = host_spi_transfer(1, x);
+    return TRUE;
+#else
     /* Clear interrupt flag */
     PIR1bits.SSP1IF = 0;   
     /* Write data */
@@ -46,14 +112,88 @@ bool ssp1_put(unsigned char x)
     /* Wait untill transmission is complete */
     while(PIR1bits.SSP1IF == 0);
     return TRUE;
+#endif
 }
 
 unsigned char ssp1_get(void)
 {
+    ssp_profile_count(SSP_CLASS_SD, SSP1CON1);
+#ifdef __HOST
+    return host_spi_transfer(1, 0xFF);
+#else
     /* Write single bogus byte */
     SSP1BUF = 0xFF;
     /* Now wait untill interface is ready */
     while(SSP1STATbits.BF == 0);
     /* Return received data */
     return SSP1BUF;
+#endif
+}
+
+void ssp1_write_block(const unsigned char *data, unsigned short length)
+/*!
+  Write 'length' bytes from 'data'. There's no waiting on a write collision here; the next
+  byte is fetched while the current one is shifted out, and written as soon as it's done.
+  With SSP1_DMA, the SPI DMA module does this
+*/
+{
+    if(length == 0) {
+        return;
+    }
+    ssp_profile_count_block(SSP_CLASS_SD, SSP1CON1, length);
+#ifdef __HOST
+    host_spi_block(1, data, NULL, length);
+#elif SSP1_DMA
+    ssp1_dma(data, NULL, length);
+#else
+    {
+        unsigned char x;
+
+        PIR1bits.SSP1IF = 0;
+        SSP1BUF = *data;
+        while(--length) {
+            data++;
+            x = *data;
+            while(PIR1bits.SSP1IF == 0);
+            PIR1bits.SSP1IF = 0;
+            SSP1BUF = x;
+        }
+        while(PIR1bits.SSP1IF == 0);
+    }
+#endif
+}
+
+void ssp1_read_block(unsigned char *data, unsigned short length)
+/*!
+  Read 'length' bytes into 'data'. Each next transfer is started right after the previous
+  byte came in, and that byte is stored while the next one is shifted in.
+  With SSP1_DMA, the SPI DMA module does this
+*/
+{
+    if(length == 0) {
+        return;
+    }
+    ssp_profile_count_block(SSP_CLASS_SD, SSP1CON1, length);
+#ifdef __HOST
+    host_spi_block(1, NULL, data, length);
+#elif SSP1_DMA
+    ssp1_dma(NULL, data, length);
+#else
+    {
+        unsigned char x;
+
+        /* Make sure BF is clear; ssp1_put() doesn't read the buffer */
+        x = SSP1BUF;
+        SSP1BUF = 0xFF;
+        while(--length) {
+            while(SSP1STATbits.BF == 0);
+            x = SSP1BUF;
+            SSP1BUF = 0xFF;
+            *data = x;
+            data++;
+        }
+        while(SSP1STATbits.BF == 0);
+        *data = SSP1BUF;
+    }
+#endif
 }
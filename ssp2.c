@@ -35,6 +35,11 @@ void ssp2_init(void)
 
 bool ssp2_put(unsigned char x)
 {
+    ssp_profile_count(ssp_profile_class, SSP2CON1);
+#ifdef __HOST
+    SSP2BUF = host_spi_transfer(2, x);
+    return TRUE;
+#else
     /* Clear interrupt flag */
     PIR3bits.SSP2IF = 0;   
     /* Write data */
@@ -46,14 +51,82 @@ bool ssp2_put(unsigned char x)
     /* Wait untill transmission is complete */
     while(PIR3bits.SSP2IF == 0);
     return TRUE;
+#endif
 }
 
 unsigned char ssp2_get(void)
 {      
+    ssp_profile_count(ssp_profile_class, SSP2CON1);
+#ifdef __HOST
+    return host_spi_transfer(2, 0xFF);
+#else
     /* Write single bogus byte */
     SSP2BUF = 0xFF;
     /* Now wait untill interface is ready */
     while(SSP2STATbits.BF == 0);
     /* Return received data */
     return SSP2BUF;
+#endif
+}
+
+void ssp2_write_block(const unsigned char *data, unsigned short length)
+/*!
+  Write 'length' bytes from 'data'. There's no waiting on a write collision here; the next
+  byte is fetched while the current one is shifted out, and written as soon as it's done
+*/
+{
+    if(length == 0) {
+        return;
+    }
+    ssp_profile_count_block(ssp_profile_class, SSP2CON1, length);
+#ifdef __HOST
+    host_spi_block(2, data, NULL, length);
+#else
+    {
+        unsigned char x;
+
+        PIR3bits.SSP2IF = 0;
+        SSP2BUF = *data;
+        while(--length) {
+            data++;
+            x = *data;
+            while(PIR3bits.SSP2IF == 0);
+            PIR3bits.SSP2IF = 0;
+            SSP2BUF = x;
+        }
+        while(PIR3bits.SSP2IF == 0);
+    }
+#endif
+}
+
+void ssp2_read_block(unsigned char *data, unsigned short length)
+/*!
+  Read 'length' bytes into 'data'. Each next transfer is started right after the previous
+  byte came in, and that byte is stored while the next one is shifted in
+*/
+{
+    if(length == 0) {
+        return;
+    }
+    ssp_profile_count_block(ssp_profile_class, SSP2CON1, length);
+#ifdef __HOST
+    host_spi_block(2, NULL, data, length);
+#else
+    {
+        unsigned char x;
+
+        /* Make sure BF is clear; ssp2_put() doesn't read the buffer */
+        x = SSP2BUF;
+        SSP2BUF = 0xFF;
+        while(--length) {
+            while(SSP2STATbits.BF == 0);
+            x = SSP2BUF;
+            SSP2BUF = 0xFF;
+            *data = x;
+            data++;
+        }
+        while(SSP2STATbits.BF == 0);
+        *data = SSP2BUF;
+    }
+#endif
 }
@@ -67,9 +67,9 @@ void uipudp_appcall(void)
     #endif
 
     #ifdef SERIALD
-    if(uip_conn->lport == HTONS(settings.network_port)) {
+    if(uip_udp_conn->lport == HTONS(settings.network_port)) {
         if(network_mode_udp()) {
-            seriald_appcall();
+            seriald_udpappcall();
         }
     }
     #endif
@@ -106,6 +106,7 @@ static void send_release(void);
 static char parse_message(void);
 
 extern void network_dhcpupdate(dhcp_parameters_t *parameters);
+extern void network_dhcpwait(const bool waiting);
 
 void dhcpc_init(void)
 {
@@ -129,6 +130,11 @@ void dhcpc_appcall(void)
 {
     static char requestresend, timeout, prescaler;
 
+    if(uip_udp_conn != conn) {
+        /* Another application's connection */
+        return;
+    }
+
     switch(state) {
         case STATE_INITIAL:
             /* Do nothing */
@@ -176,6 +182,7 @@ void dhcpc_appcall(void)
                     prescaler = 0;
                     /* Okay, we got a configuration! */
                     UIP_DEBUG("dhcpc: got configuration\n\r");
+                    network_dhcpwait(FALSE);
                     network_dhcpupdate(&parameters);
                 }
                 else {
@@ -263,6 +270,7 @@ void dhcpc_appcall(void)
             parameters.router[3] = 0;
             parameters.leasetime[0] = 0;
             parameters.leasetime[1] = 0;
+            network_dhcpwait(FALSE);
             network_dhcpupdate(&parameters);
             state = STATE_INITIAL;
             break;
@@ -374,8 +382,9 @@ static void send_discovery(void)
     /* Close packet */
     message->options[8] = DHCP_OPTION_END;
 
-    /* And send it */
+    /* And send it, and make sure the reply can get in */
     uip_udp_send(DHCP_MESSAGE_LENGTH + 9);
+    network_dhcpwait(TRUE);
 }
 
 static void send_request(void)
@@ -407,8 +416,9 @@ static void send_request(void)
     /* Close packet */
     message->options[15] = DHCP_OPTION_END;
 
-    /* And send it */
+    /* And send it, and make sure the reply can get in */
     uip_udp_send(DHCP_MESSAGE_LENGTH + 16);
+    network_dhcpwait(TRUE);
 }
 
 static void send_release(void)
@@ -16,6 +16,8 @@ DHCP client
 #ifndef DHCPC_C
 #define DHCPC_C
 
+#include <types.h>
+
 typedef struct {
     unsigned char serverid[4];
     unsigned char ipaddr[4];
@@ -30,8 +32,8 @@ void dhcpc_getlease(void);
 void dhcpc_appcall(void);
 void dhcpc_renew(void);
 void dhcpc_release(void);
-char dhcpc_running(void);
-char dhcpc_gotlease(void);
+bool dhcpc_running(void);
+bool dhcpc_gotlease(void);
 dhcp_parameters_t* dhcpc_getparameters(void);
 
 #endif /* DHCPC_C */
@@ -16,60 +16,293 @@ Serial-to-ethernet
 #include "seriald.h"
 #include "settings.h"
 #include "debug.h"
+#include "serial.h"
+#include "io.h"
 #include "enc28j60_freebuffer.h"
 #include "uip.h"
 #include "uip_arp.h"
+#include "uip_split.h"
 
 /* Application state */
-unsigned char state;
+static unsigned char state;
 #define STATE_IDLE      0
 #define STATE_CONNECTED 1
 #define STATE_CLOSE     2
 #define STATE_SHUTDOWN  3
 
 /* Our client */
-uip_ipaddr_t connected_to_ipaddr;
-u16_t connected_to_port;
+static uip_ipaddr_t connected_to_ipaddr;
+static u16_t connected_to_port;
 
-/* Incoming serial data, double buffered */
-unsigned char buffer[2][100];
-unsigned char pointer[2];
-unsigned char write, read;
-bool polled_without_transfer;
+/* In UDP mode, datagrams come in on 'udp_listener', from anyone, and go out on 'udp_sender',
+   to the configured peer or to whoever sent the last datagram. Connected once there's
+   someone to send to */
+#define UDPBUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+static struct uip_udp_conn *udp_listener, *udp_sender;
+static bool resolving;                          /* The datagram being filled went out as an ARP request instead */
 
-/* Bytes in transfer (that is, called uip_send(), no ack received yet) */
-unsigned short bytesintransfer;
+/* Incoming serial data, in a ring buffer. seriald_int_rx() (the UART interrupt) is the
+   only one that moves head, the main loop is the only one that moves tail, so neither has
+   to keep the other out. Empty when head equals tail */
+#if SERIALD_RXBUFFER_SIZE > 256 || (SERIALD_RXBUFFER_SIZE & (SERIALD_RXBUFFER_SIZE - 1))
+#error "SERIALD_RXBUFFER_SIZE should be a power of two, and at most 256"
+#endif
+#define RXBUFFER_MASK   (SERIALD_RXBUFFER_SIZE - 1)
+static unsigned char rxbuffer[SERIALD_RXBUFFER_SIZE];
+static volatile unsigned char rxhead, rxtail;
+static bool polled_without_transfer;
+
+/* Flowcontrol; seriald_int_rx() asks the other side to hold on when the receivebuffer
+   fills up (deasserts RTS, sends XOFF), the main loop lets it continue once it's drained
+   (see release()). RTS is also deasserted from reset until the main loop runs */
+static volatile unsigned char flowcontrol;      /* SERIAL_MODE_FLOWCONTROL_*, as applied */
+static volatile bool held;                      /* The other side is asked to hold on */
+static volatile bool escaped;                   /* XON, XOFF and SERIAL_ESCAPE are escaped in the data.. */
+static bool unescape;                           /* ..and the last byte was SERIAL_ESCAPE */
+
+/* Auto-baud detection; seriald_int_rx() starts it again after settings.serial_autobaud
+   framing errors, the main loop stores the baudrate it finds (see locked()) */
+static volatile bool autobaud;                  /* Measuring the next character.. */
+static volatile bool autobauded;                /* ..done, and this is the baudrate generator value */
+static volatile unsigned int autobaudrate;
+static unsigned char framingerrors;             /* Since the last measurement */
+
+/* Packetizer; decides when serial data goes out without waiting for the next poll, see
+   seriald_shouldtransfer() */
+extern volatile unsigned char system_ticks;
+static unsigned char lasthead;                  /* rxhead, as last seen by seriald_shouldtransfer() */
+static bool waiting;                            /* There's serial data that's not yet handed to uIP.. */
+static unsigned char waitstart;                 /* ..since this system tick */
+static bool flush;                              /* Hand it over as soon as possible */
+static unsigned short idleticks;                /* settings.serial_idlegap, in Timer3 ticks */
+static unsigned char latencyticks;              /* settings.serial_maxlatency, in system ticks */
 
-/* Checksum of outgoing packet(s), */
-extern u16_t uip_tcpchksum_incontroller_1, uip_tcpchksum_incontroller_2;
+/* Framing; with a delimiter set, records (data up to and including the delimiter) go out
+   whole. seriald_int_rx() looks for the delimiter as bytes come in */
+static unsigned char delimiter[4];
+static unsigned char delimiterfallback[4];      /* Delimiter bytes still matched after a mismatch, or after a match */
+static volatile unsigned char delimiterlength;  /* 0 when not framing */
+static unsigned char delimitermatched;          /* Delimiter bytes matched so far */
+static volatile unsigned char rxrecordend;      /* Receivebuffer position right after the last delimiter.. */
+static volatile unsigned char rxrecords;        /* ..and the no. of delimiters seen, wrapping around */
+static unsigned char records;                   /* rxrecords, as last seen by seriald_shouldtransfer().. */
+static unsigned char recordend;                 /* ..and rxrecordend with it */
+static bool complete;                           /* There are whole records in the receivebuffer, up to recordend */
+static bool partial;                            /* The segment being filled ends in the middle of a record */
+
+/* Our connection, to poll when there's something to flush */
+static struct uip_conn *connection;
+
+/* The controller's free buffer holds SERIALD_WINDOW segments, each with room for the
+   headers, the payload and the statusvector the controller writes after it. The ones in
+   flight (that is, called uip_send(), no ack received yet) stay there until they're
+   acknowledged, the next one is filled meanwhile */
+#define SEGMENT_SPACE           (FREEBUFFERLENGTH / SERIALD_WINDOW)
+#define SEGMENT_SIZE            (SEGMENT_SPACE - TCPIP4_HEADER_LENGTH - TXSTATUSVECTORLENGTH)
+#define SEGMENT_OFFSET(i)       ((i) * SEGMENT_SPACE)
+/* A datagram's headers are shorter, and end where a segment's would; the payload is at
+   the same place in both */
+#define DATAGRAM_OFFSET(i)      (SEGMENT_OFFSET(i) + TCPIP4_HEADER_LENGTH - UDPIP4_HEADER_LENGTH)
+static struct {
+    unsigned short acked;                       /* Payload that's acknowledged already.. */
+    unsigned short length;                      /* ..and what's still in flight after that */
+} segment[SERIALD_WINDOW];
+static unsigned char segment_first;             /* Oldest segment in flight.. */
+static unsigned char segment_count;             /* ..and the no. of segments in flight */
+static unsigned char segment_lost;              /* Segments that were in flight at the last retransmission timeout, still to be ACK'd */
+static bool full;                               /* The segment being filled can't take more */
 
 seriald_statistics_t seriald_statistics;
 
+static bool udp_lastsender(void)
+/*!
+  Do datagrams go to whoever sent the last one, instead of a configured peer?
+*/
+{
+    return settings.network_peer[0] == 0 && settings.network_peer[1] == 0 && settings.network_peer[2] == 0 && settings.network_peer[3] == 0;
+}
+
+static void start(void)
+/*!
+  There's someone to send to now; drop whatever came in before, and what's left from the
+  last connection
+*/
+{
+    state = STATE_CONNECTED;
+    rxtail = rxhead;
+    waiting = FALSE;
+    flush = FALSE;
+    segment_first = 0;
+    segment_count = 0;
+    segment_lost = 0;
+    enc28j60_put_freebuffer_restart();
+    partial = FALSE;
+    full = FALSE;
+    resolving = FALSE;
+    seriald_connected();
+}
+
 void seriald_init(void)
 /*!
   
 */
 {
-    if(network_mode_tcp()) {
-        uip_listen(HTONS(settings.network_port));
-        dprint("seriald_init(): listening on TCP port %d\n\r", settings.network_port);
-    }
-
     state = STATE_IDLE;
 
-    write = 0;
-    read = 1;
-    pointer[write] = 0;
-    pointer[read] = 0;
+    rxhead = 0;
+    rxtail = 0;
 
-    bytesintransfer = 0;
+    segment_first = 0;
+    segment_count = 0;
+    segment_lost = 0;
+    partial = FALSE;
+    full = FALSE;
+    resolving = FALSE;
 
     seriald_statistics.retransmitted = 0;
     seriald_statistics.net_dropped = 0;
     seriald_statistics.uart_dropped = 0;
+    seriald_statistics.serial_dropped = 0;
     seriald_statistics.controller_full = 0;
 
     polled_without_transfer = FALSE;
+
+    seriald_configure();
+
+    if(network_mode_tcp()) {
+        uip_listen(HTONS(settings.network_port));
+        dprint("seriald_init(): listening on TCP port %d\n\r", settings.network_port);
+    }
+    else {
+        udp_listener = uip_udp_new(NULL, 0);
+        udp_sender = uip_udp_new(NULL, 0);
+        if(udp_listener == NULL || udp_sender == NULL) {
+            dprint("seriald_init(): no free UDP connections\n\r");
+            seriald_shutdown();
+            return;
+        }
+        uip_udp_bind(udp_listener, HTONS(settings.network_port));
+        uip_udp_bind(udp_sender, HTONS(settings.network_port));
+        dprint("seriald_init(): listening on UDP port %d\n\r", settings.network_port);
+        if(!udp_lastsender()) {
+            uip_ipaddr(udp_sender->ripaddr, settings.network_peer[0], settings.network_peer[1], settings.network_peer[2], settings.network_peer[3]);
+            udp_sender->rport = HTONS(settings.network_peerport);
+            start();
+        }
+    }
+}
+
+static void idlegap(void)
+/*!
+  settings.serial_idlegap in Timer3 ticks, at the current baudrate
+*/
+{
+    unsigned long ticks;
+
+    ticks = settings.serial_idlegap * SERIAL2_IDLETICKS_PER_CHAR(settings.serial_baudrate);
+    if(ticks > 0xFFFF) {
+        /* Timer3 can't wait any longer */
+        ticks = 0xFFFF;
+    }
+    idleticks = ticks;
+}
+
+void seriald_configure(void)
+/*!
+  Apply the packetizer settings; serial_idlegap, serial_maxlatency, serial_minfill and the
+  delimiter. And the flowcontrol
+*/
+{
+    unsigned long ticks;
+    unsigned char i, k;
+
+    idlegap();
+
+    ticks = (settings.serial_maxlatency + 9) / 10;
+    if(ticks > 0xFF) {
+        ticks = 0xFF;
+    }
+    latencyticks = ticks;
+
+    if(settings.serial_minfill == 0) {
+        settings.serial_minfill = SERIALD_RXBUFFER_SIZE / 2;
+    }
+    else if(settings.serial_minfill > SERIALD_FLOW_HIGH) {
+        /* The ring holds more than this only when flowcontrol doesn't stop the sender */
+        settings.serial_minfill = SERIALD_FLOW_HIGH;
+    }
+
+    /* Framing is off while the delimiter changes, so seriald_int_rx() won't use half of it */
+    delimiterlength = 0;
+    if(settings.serial_delimiterlength > sizeof(delimiter)) {
+        settings.serial_delimiterlength = 0;
+    }
+    for(i=0;i<settings.serial_delimiterlength;i++) {
+        delimiter[i] = settings.serial_delimiter[i];
+    }
+    /* For each no. of matched bytes (minus one), how many still match when the next byte
+       doesn't, or when the delimiter is complete. That's the longest part at the end of
+       what's matched that's also the start of the delimiter */
+    delimiterfallback[0] = 0;
+    k = 0;
+    for(i=1;i<settings.serial_delimiterlength;i++) {
+        while(k && delimiter[i] != delimiter[k]) {
+            k = delimiterfallback[k-1];
+        }
+        if(delimiter[i] == delimiter[k]) {
+            k++;
+        }
+        delimiterfallback[i] = k;
+    }
+    delimitermatched = 0;
+    records = rxrecords;
+    complete = FALSE;
+    delimiterlength = settings.serial_delimiterlength;
+
+    lasthead = rxhead;
+    waiting = FALSE;
+    flush = FALSE;
+
+    /* Without flowcontrol, RTS just stays asserted and nothing's held; with it,
+       seriald_int_rx() and release() take over */
+    if(held && flowcontrol == SERIAL_MODE_FLOWCONTROL_XONXOFF) {
+        serial2_putcontrol(SERIAL_XON);
+    }
+    flowcontrol = SERIAL_MODE_FLOWCONTROL_NONE;
+    held = FALSE;
+    serial_rts_assert();
+    serial2_xoff(FALSE);
+    escaped = serial_flowcontrol_escaped();
+    unescape = FALSE;
+    if(serial_flowcontrol_rtscts()) {
+        serial_rts_deassert();
+        held = TRUE;
+    }
+    flowcontrol = settings.serial_mode & SERIAL_MODE_FLOWCONTROL;
+    serial2_ctsflow(serial_flowcontrol_rtscts());
+}
+
+void seriald_autobaud(void)
+/*!
+  Measure the baudrate from the next character received, which should be
+  SERIAL_AUTOBAUD_SYNC ('U'). What's found is stored in the settings
+*/
+{
+    framingerrors = 0;
+    autobaud = TRUE;
+    serial2_autobaud_start();
+}
+
+static void locked(void)
+/*!
+  seriald_int_rx() measured the baudrate; keep it, and follow it with the idle gap. Only
+  the baudrate is stored, other settings may have been changed without saving them
+*/
+{
+    autobauded = FALSE;
+    settings.serial_baudrate = autobaudrate;
+    idlegap();
+    settings_storebaudrate();
 }
 
 void seriald_shutdown(void)
@@ -77,7 +310,22 @@ void seriald_shutdown(void)
   
 */
 {
-    if(state != STATE_IDLE) {
+    if(network_mode_udp()) {
+        /* Nothing to close; just stop */
+        if(udp_listener != NULL) {
+            uip_udp_remove(udp_listener);
+            udp_listener = NULL;
+        }
+        if(udp_sender != NULL) {
+            uip_udp_remove(udp_sender);
+            udp_sender = NULL;
+        }
+        if(state != STATE_IDLE) {
+            state = STATE_IDLE;
+            seriald_disconnected();
+        }
+    }
+    else if(state != STATE_IDLE) {
         state = STATE_SHUTDOWN;
     }
 }
@@ -87,109 +335,441 @@ void seriald_disconnect(void)
   
 */
 {
-    if(state != STATE_IDLE) {
+    /* Datagrams don't need a connection, they just keep going to the peer */
+    if(state != STATE_IDLE && network_mode_tcp()) {
         state = STATE_CLOSE;
     }
 }
 
-void seriald_incoming(const unsigned char c)
+void seriald_int_rx(void)
 /*!
-  Store incoming byte in our write-buffer
+  UART2 receive interrupt; stores what's in the receive FIFO in the receivebuffer, all of
+  it in one go. Kept lean, at 921600 baud a byte comes in every 130 instruction cycles
 */
 {
-    if(pointer[write] < sizeof(buffer[write])) {
-        buffer[write][pointer[write]] = c;
-        pointer[write]++;
-    }
-    else {
-        seriald_statistics.net_dropped++;
+    unsigned char head = rxhead;
+    unsigned char next;
+    unsigned char matched;
+    unsigned char c;
+
+    do {
+        if(autobaud) {
+            c = RCREG2;
+            if(serial2_autobaud_busy()) {
+                /* Came in before the measurement started */
+                continue;
+            }
+            if(serial2_autobaud_overflow()) {
+                /* Nothing sensible measured; wait for the next sync */
+                serial2_autobaud_start();
+                continue;
+            }
+            /* Measured; that character was the sync, not data */
+            autobaudrate = serial2_autobaud_result();
+            serial2_setbaudrate(autobaudrate);
+            autobaud = FALSE;
+            autobauded = TRUE;
+            continue;
+        }
+        if(RCSTA2bits.OERR) {
+            /* Overrun error, the FIFO is lost. Clear by toggeling RCSTA.CREN */
+            RCSTA2bits.CREN = 0;
+            RCSTA2bits.CREN = 1;
+            seriald_statistics.uart_dropped++;
+            return;
+        }
+        if(RCSTA2bits.FERR) {
+            /* Framing error. Clear by reading RCREG */
+            c = RCREG2;
+            if(settings.serial_autobaud && ++framingerrors >= settings.serial_autobaud) {
+                /* Most likely the wrong baudrate; measure it again */
+                framingerrors = 0;
+                autobaud = TRUE;
+                serial2_autobaud_start();
+                return;
+            }
+            continue;
+        }
+        c = RCREG2;
+
+        if(flowcontrol == SERIAL_MODE_FLOWCONTROL_XONXOFF) {
+            /* Flowcontrol characters are for us, escaped ones are data */
+            if(c == SERIAL_XOFF || c == SERIAL_XON) {
+                serial2_xoff(c == SERIAL_XOFF);
+                continue;
+            }
+            if(unescape) {
+                c ^= SERIAL_ESCAPE_XOR;
+                unescape = FALSE;
+            }
+            else if(c == SERIAL_ESCAPE && escaped) {
+                unescape = TRUE;
+                continue;
+            }
+        }
+
+        next = (head + 1) & RXBUFFER_MASK;
+        if(next == rxtail) {
+            seriald_statistics.net_dropped++;
+            continue;
+        }
+        rxbuffer[head] = c;
+        /* Only now the byte is there, it can be seen */
+        rxhead = next;
+        head = next;
+
+        if(flowcontrol != SERIAL_MODE_FLOWCONTROL_NONE && !held && ((next - rxtail) & RXBUFFER_MASK) >= SERIALD_FLOW_HIGH) {
+            /* Filling up; the other side should hold on */
+            held = TRUE;
+            if(flowcontrol == SERIAL_MODE_FLOWCONTROL_XONXOFF) {
+                serial2_putcontrol(SERIAL_XOFF);
+            }
+            else {
+                serial_rts_deassert();
+            }
+        }
+
+        if(delimiterlength) {
+            /* One step of the delimiter search */
+            matched = delimitermatched;
+            while(matched && c != delimiter[matched]) {
+                matched = delimiterfallback[matched-1];
+            }
+            if(c == delimiter[matched]) {
+                matched++;
+            }
+            if(matched == delimiterlength) {
+                /* End of a record; position first, it's valid once the count changes */
+                rxrecordend = next;
+                rxrecords++;
+                matched = delimiterfallback[matched-1];
+            }
+            delimitermatched = matched;
+        }
+    } while(PIR3bits.RC2IF);
+}
+
+static unsigned char pending(void)
+/*!
+  No. of bytes in the receivebuffer
+*/
+{
+    return (unsigned char)(rxhead - rxtail) & RXBUFFER_MASK;
+}
+
+static void release(void)
+/*!
+  Let the other side continue, once the receivebuffer is down to SERIALD_FLOW_LOW
+*/
+{
+    if(held && pending() <= SERIALD_FLOW_LOW) {
+        held = FALSE;
+        if(flowcontrol == SERIAL_MODE_FLOWCONTROL_XONXOFF) {
+            serial2_putcontrol(SERIAL_XON);
+        }
+        else {
+            serial_rts_assert();
+        }
     }
 }
 
-void seriald_dropped(void)
+static void transmitted(void)
+/*!
+  Release the datagrams the ethernet controller is done with. Nothing acknowledges them,
+  they can go once they're out on the wire; the oldest first, they're sent in order
+*/
 {
-    seriald_statistics.uart_dropped++;
+    while(segment_count && !enc28j60_put_queued(FREESTART + DATAGRAM_OFFSET(segment_first))) {
+        segment_first++;
+        if(segment_first == SERIALD_WINDOW) {
+            segment_first = 0;
+        }
+        segment_count--;
+    }
 }
 
 bool seriald_shouldtransfer(void)
 /*!
-  
+  Keeps track of the serial line, and tells if there's data to move to the controller;
+  once serial_minfill bytes came in, or right away when the line went quiet for
+  serial_idlegap character times or data waited for serial_maxlatency. In the last two
+  cases it's flushed as well, see seriald_flush().
+  When framing, whole records are moved and flushed as soon as their delimiter came in
+  instead; a record is only moved in parts when it fills serial_minfill
 */
 {
-    if(pointer[write] == 0) {
+    unsigned char head = rxhead;
+    unsigned char length = pending();
+
+    if(autobauded) {
+        locked();
+    }
+    release();
+    if(head != lasthead) {
+        /* New data, so the line isn't idle */
+        lasthead = head;
+        if(idleticks) {
+            serial2_idletimer_start(idleticks);
+        }
+        if(!waiting) {
+            waiting = TRUE;
+            waitstart = system_ticks;
+        }
+    }
+    else if(waiting && idleticks && serial2_idletimer_expired() && !delimiterlength) {
+        flush = TRUE;
+    }
+    if(waiting && latencyticks && (unsigned char)(system_ticks - waitstart) >= latencyticks && !delimiterlength) {
+        flush = TRUE;
+    }
+    if(rxrecords != records) {
+        /* Another record is in; count first, see seriald_int_rx() */
+        records = rxrecords;
+        recordend = rxrecordend;
+        complete = TRUE;
+        flush = TRUE;
+    }
+
+    if(length == 0) {
         /* No pending data, at all */
         return FALSE;
     }
 
-    if(bytesintransfer) {
-        /* Data currently in controller isn't ACK'd yet */
+    if(network_mode_udp()) {
+        transmitted();
+    }
+    if(segment_count == SERIALD_WINDOW || full) {
+        /* No segment to add to, until the oldest one is ACK'd (or, for a datagram,
+           transmitted) or the full one is sent */
         return FALSE;
     }
 
-    if(pointer[write] > (sizeof(buffer[write]) / 2) || polled_without_transfer) {
-        /* We where polled without sending anything, or write buffer has reached it's threshold */
+    if(length >= settings.serial_minfill || polled_without_transfer || flush || held) {
+        /* We where polled without sending anything, write buffer has reached it's threshold,
+           the data shouldn't wait any longer, or the other side is held up */
         return TRUE;
     }
     return FALSE;
 }
 
-void seriald_switchbuffers(void)
+static unsigned char filling(void)
 /*!
-  
+  The segment that's being filled; the one after those in flight
+*/
+{
+    unsigned char i = segment_first + segment_count;
+
+    if(i >= SERIALD_WINDOW) {
+        i -= SERIALD_WINDOW;
+    }
+    return i;
+}
+
+static void transfer(const unsigned char *data, const u8_t length)
+/*!
+  Copy 'length' bytes to the payload of the segment that's being filled
+*/
+{
+    /* Just copy; payload checksums are calculated by the ethernet controller when sending */
+    enc28j60_put_freebuffer_payload(SEGMENT_OFFSET(filling()) + TCPIP4_HEADER_LENGTH, data, length);
+}
+
+static bool ready(void)
+/*!
+  Should the segment that's being filled go out? When it's full, or when it's flushed or
+  was polled for and doesn't end in the middle of a record. Not while lost segments are
+  retransmitted though, or while the datagram waits for the peer's address to be resolved;
+  the ARP request is repeated on the periodic poll
+*/
+{
+    return enc28j60_freebuffer_written && !segment_lost && !resolving &&
+           (full || (!partial && (polled_without_transfer || flush)));
+}
+
+struct uip_conn *seriald_flush(void)
+/*!
+  Returns the connection to poll when there's a segment that should be sent right away,
+  NULL otherwise. Polling it makes seriald_appcall() send
+*/
+{
+    if(state == STATE_CONNECTED && network_mode_tcp() && ready()) {
+        return connection;
+    }
+    return NULL;
+}
+
+struct uip_udp_conn *seriald_udpflush(void)
+/*!
+  As seriald_flush(), for a datagram; polling the returned connection makes
+  seriald_udpappcall() send
+*/
+{
+    if(resolving && uip_arp_known(udp_sender->ripaddr)) {
+        /* The peer's address came in; the datagram that waited for it can go */
+        resolving = FALSE;
+    }
+    if(state == STATE_CONNECTED && network_mode_udp() && ready()) {
+        return udp_sender;
+    }
+    return NULL;
+}
+
+static void output(const unsigned char i)
+/*!
+  Send segment 'i', or what's not acknowledged of it
 */
 {
-    write = (!write) & 1;
-    read = (!read) & 1;
+    if(network_mode_udp()) {
+        /* The headers go right before the payload */
+        uip_split_incontroller_offset = DATAGRAM_OFFSET(i);
+        uip_send(NULL, segment[i].length);
+        return;
+    }
+    /* In one packet; with several segments in flight, delayed ACKs don't hold things up */
+    uip_split_incontroller_size = UIP_SPLIT_NONE;
+    /* The headers go right before the payload, over what's acknowledged already */
+    uip_split_incontroller_offset = SEGMENT_OFFSET(i) + segment[i].acked;
+    /* Calling uip_send with a NULL-pointer so that uIP knows the
+       packet is already in the ethernet controller RAM */
+    uip_send(NULL, segment[i].length);
+}
+
+static void send(void)
+/*!
+  Send the segment that's being filled, and start on the next one
+*/
+{
+    unsigned char i = filling();
+
+    segment[i].acked = 0;
+    segment[i].length = enc28j60_freebuffer_written;
+    if(network_mode_udp()) {
+        /* uip_arp_out() turns the datagram into an ARP request when the peer's address isn't
+           known; then it stays where it is, and goes out again on the next poll */
+        resolving = !uip_arp_known(udp_sender->ripaddr);
+        output(i);
+        if(resolving) {
+            return;
+        }
+    }
+    else {
+        output(i);
+    }
+    segment_count++;
+    if(segment_count == SERIALD_WINDOW) {
+        seriald_statistics.controller_full++;
+    }
+
+    /* And cleanup */
+    enc28j60_put_freebuffer_restart();
+    partial = FALSE;
+    full = FALSE;
+
+    /* What's still in the receivebuffer waits from now on */
+    flush = FALSE;
+    waiting = pending() != 0;
+    waitstart = system_ticks;
+}
+
+static bool acknowledged(unsigned short length)
+/*!
+  Release the segments that are acknowledged; 'length' bytes, starting with the oldest.
+  Returns TRUE when the oldest segment that's left should be retransmitted right away;
+  after a timeout, the ones that were in flight with the lost one are likely lost too
+*/
+{
+    while(length && segment_count) {
+        if(length < segment[segment_first].length) {
+            /* Part of it; the rest is still in flight */
+            segment[segment_first].acked += length;
+            segment[segment_first].length -= length;
+            break;
+        }
+        length -= segment[segment_first].length;
+        segment_first++;
+        if(segment_first == SERIALD_WINDOW) {
+            segment_first = 0;
+        }
+        segment_count--;
+        if(segment_lost) {
+            segment_lost--;
+        }
+    }
+    return segment_lost && segment_count;
 }
 
 void seriald_transfer(void)
 /*!
-  
+  Move what's in the receivebuffer to the segment that's being filled, as far as it fits.
+  The UART interrupt keeps adding bytes meanwhile; those are left for the next call
 */
 {
-    extern u16_t uip_chksum_singlebytes;
-    u8_t len1, len2;
-
-    // TODO: remaining-space, should be smarter about this
-    if(enc28j60_freebuffer_written + pointer[read]  < FREEBUFFERLENGTH - (2 * TCPIP4_HEADER_LENGTH)) {
-#if UIP_SPLIT     
-        if(enc28j60_freebuffer_written > UIP_SPLIT_SIZE) {
-            /* Already working on the second packet */
-            uip_tcpchksum_incontroller_2 = uip_chksum_bytes(uip_tcpchksum_incontroller_2, buffer[read], pointer[read]);
-            enc28j60_put_freebuffer_payload(2 * TCPIP4_HEADER_LENGTH, buffer[read], pointer[read]);
-        }
-        else if(enc28j60_freebuffer_written + pointer[read] == UIP_SPLIT_SIZE) {
-            /* We'll fill the first packet */
-            uip_tcpchksum_incontroller_1 = uip_chksum_bytes(uip_tcpchksum_incontroller_1, buffer[read], pointer[read]);
-            /* Reset checksum calculation */
-            uip_chksum_singlebytes = 0;
-            enc28j60_put_freebuffer_payload(TCPIP4_HEADER_LENGTH, buffer[read], pointer[read]);
-        }
-        else if(enc28j60_freebuffer_written + pointer[read] > UIP_SPLIT_SIZE) {
-            /* We'll write to the first AND the second packet */
-            len1 = pointer[read] - ((enc28j60_freebuffer_written + pointer[read]) - UIP_SPLIT_SIZE);
-            len2 = (enc28j60_freebuffer_written + pointer[read]) - UIP_SPLIT_SIZE;
-            uip_tcpchksum_incontroller_1 = uip_chksum_bytes(uip_tcpchksum_incontroller_1, buffer[read], len1);
-            /* Reset checksum calculation */
-            uip_chksum_singlebytes = 0;
-            uip_tcpchksum_incontroller_2 = uip_chksum_bytes(uip_tcpchksum_incontroller_2, &buffer[read][len1], len2);
-
-            enc28j60_put_freebuffer_payload(TCPIP4_HEADER_LENGTH, buffer[read], len1);
-            enc28j60_put_freebuffer_payload(2* TCPIP4_HEADER_LENGTH, &buffer[read][len1], len2);
+    unsigned char tail = rxtail;
+    unsigned char length = pending();
+    unsigned short room = SEGMENT_SIZE - enc28j60_freebuffer_written;
+    unsigned short chunk;
+    bool whole = TRUE;
+
+    if(delimiterlength) {
+        if(complete) {
+            /* Whole records first */
+            length = (unsigned char)(recordend - tail) & RXBUFFER_MASK;
+        }
+        else if(length < settings.serial_minfill && !held) {
+            /* Nothing but the start of a record */
+            return;
         }
         else {
-            /* Still working on the first packet */
-            uip_tcpchksum_incontroller_1 = uip_chksum_bytes(uip_tcpchksum_incontroller_1, buffer[read], pointer[read]);
-            enc28j60_put_freebuffer_payload(TCPIP4_HEADER_LENGTH, buffer[read], pointer[read]);
+            /* A record that's too big to wait for its end */
+            whole = FALSE;
         }
-#else
-        uip_tcpchksum_incontroller = uip_chksum_bytes(uip_tcpchksum_incontroller, buffer[read], pointer[read]);
-        enc28j60_put_freebuffer_payload(TCPIP4_HEADER_LENGTH, buffer[read], pointer[read]);
-#endif
-        pointer[read] = 0;
+    }
+
+    if(length > room) {
+        if(delimiterlength && whole && enc28j60_freebuffer_written && !partial) {
+            /* Don't split records over segments; they go in the next one */
+            full = TRUE;
+            return;
+        }
+        /* Fill up this segment, the rest goes in the next one */
+        length = room;
+        whole = FALSE;
+    }
+
+    /* The data is in one piece, or wraps around the end of the buffer */
+    chunk = SERIALD_RXBUFFER_SIZE - tail;
+    if(chunk >= length) {
+        transfer(&rxbuffer[tail], length);
     }
     else {
-        seriald_statistics.controller_full++;
+        transfer(&rxbuffer[tail], chunk);
+        transfer(rxbuffer, length - chunk);
+    }
+    /* Room for the interrupt to use again */
+    rxtail = (tail + length) & RXBUFFER_MASK;
+
+    if(delimiterlength) {
+        if(whole) {
+            /* Everything up to recordend is out of the receivebuffer now */
+            complete = FALSE;
+        }
+        partial = !whole;
+    }
+    if(enc28j60_freebuffer_written == SEGMENT_SIZE) {
+        full = TRUE;
+    }
+}
+
+static void received(void)
+/*!
+  Hand new data to the application. When it's still in the ethernet controller, or more
+  is waiting for UART2 than we like, stop receiving until it's sent out; see
+  seriald_receivebusy()
+*/
+{
+    seriald_received(uip_appdata, uip_datalen());
+    if(seriald_receivebusy()) {
+        uip_stop();
     }
 }
 
@@ -208,9 +788,8 @@ void seriald_appcall(void)
                                                               uip_ipaddr3(connected_to_ipaddr),
                                                               uip_ipaddr4(connected_to_ipaddr),
                                                               connected_to_port);
-                state = STATE_CONNECTED;
-                pointer[write] = 0;
-                seriald_connected();
+                connection = uip_conn;
+                start();
              }
             break;
         case STATE_CONNECTED:
@@ -220,29 +799,28 @@ void seriald_appcall(void)
                     seriald_disconnected();
                 }
                 else if(uip_rexmit()) {
-                    if(bytesintransfer) {
-                        seriald_statistics.retransmitted += bytesintransfer;
-                        uip_send(NULL, bytesintransfer);
+                    if(segment_count) {
+                        /* Just the oldest segment; the ACK for it tells what else is
+                           missing, see acknowledged() */
+                        segment_lost = segment_count;
+                        seriald_statistics.retransmitted += segment[segment_first].length;
+                        output(segment_first);
                     }
                     else {
                         dprint("seriald_appcall(): cannot retransmit!\n\r");
                     }
                 }
                 else if(uip_poll() || uip_acked()) {
-                    if(uip_acked()) {
-                        bytesintransfer = 0;
-                        uip_tcpchksum_incontroller_1 = 0;
-                        uip_tcpchksum_incontroller_2 = 0;
+                    if(uip_acked() && acknowledged(uip_acklen)) {
+                        /* Before anything new */
+                        uip_resend();
+                        seriald_statistics.retransmitted += segment[segment_first].length;
+                        output(segment_first);
                     }
-
-                    if(enc28j60_freebuffer_written > 1000 || polled_without_transfer) {
-                        if(bytesintransfer == 0) {
-                            /* Calling uip_send with a NULL-pointer so that uIP knows the
-                               packet is already in the ethernet controller RAM */
-                            uip_send(NULL, enc28j60_freebuffer_written);
-                            /* And cleanup */
-                            bytesintransfer = enc28j60_freebuffer_written;
-                            enc28j60_put_freebuffer_restart();
+                    else if(ready()) {
+                        if(uip_cansend(enc28j60_freebuffer_written)) {
+                            /* Behind whatever's still in flight */
+                            send();
                         }
                         polled_without_transfer = FALSE;
                     }
@@ -252,11 +830,16 @@ void seriald_appcall(void)
 
                     if(uip_newdata()) {
                         /* ACK and CLOSE can be combined! */
-                        seriald_received(uip_appdata, uip_datalen());
+                        received();
+                    }
+
+                    if(uip_stopped(uip_conn) && !seriald_receivebusy()) {
+                        /* Received data is out, open the receive window again */
+                        uip_restart();
                     }
                 }
                 else if(uip_newdata()) {
-                    seriald_received(uip_appdata, uip_datalen());
+                    received();
                 }
                 else {
                     dprint("seriald unhandled state while connected, uip_flags=%d\n\r", uip_flags);
@@ -280,3 +863,42 @@ void seriald_appcall(void)
             break;
     }
 }
+
+void seriald_udpappcall(void)
+/*!
+  
+*/
+{
+    if(uip_newdata()) {
+        if(udp_lastsender()) {
+            /* Answer whoever sent this */
+            if(!uip_ipaddr_cmp(udp_sender->ripaddr, UDPBUF->srcipaddr) || udp_sender->rport != UDPBUF->srcport) {
+                uip_ipaddr_copy(udp_sender->ripaddr, UDPBUF->srcipaddr);
+                udp_sender->rport = UDPBUF->srcport;
+                /* Datagrams go elsewhere now */
+                uip_split_forget();
+            }
+            if(state == STATE_IDLE) {
+                dprint("seriald sending to %d.%d.%d.%d:%d\n\r", uip_ipaddr1(udp_sender->ripaddr),
+                                                                uip_ipaddr2(udp_sender->ripaddr),
+                                                                uip_ipaddr3(udp_sender->ripaddr),
+                                                                uip_ipaddr4(udp_sender->ripaddr),
+                                                                HTONS(udp_sender->rport));
+                start();
+            }
+        }
+        if(state == STATE_CONNECTED) {
+            seriald_received(uip_appdata, uip_datalen());
+        }
+    }
+    else if(uip_poll() && uip_udp_conn == udp_sender && state == STATE_CONNECTED) {
+        if(ready() || (resolving && enc28j60_freebuffer_written)) {
+            /* No ACKs to wait for; it goes as soon as the controller has room for it */
+            send();
+            polled_without_transfer = FALSE;
+        }
+        else {
+            polled_without_transfer = TRUE;
+        }
+    }
+}
@@ -18,25 +18,49 @@ Serial-to-ethernet
 
 #include "config.h"
 
+/* Size of the receivebuffer for serial data, in bytes; a power of two, at most 256. It
+   holds one byte less than this */
+#define SERIALD_RXBUFFER_SIZE   256
+
+/* With flowcontrol, the other side is asked to hold on (RTS deasserted, XOFF sent) once
+   the receivebuffer holds this much; the rest is room for what it sends before it
+   notices.. */
+#define SERIALD_FLOW_HIGH       (SERIALD_RXBUFFER_SIZE - 32)
+/* ..and to continue (RTS asserted, XON sent) once it's down to this */
+#define SERIALD_FLOW_LOW        (SERIALD_RXBUFFER_SIZE / 4)
+
+/* Framing errors after which 'seriald baud auto' measures the baudrate again, unless
+   given */
+#define SERIALD_AUTOBAUD_ERRORS 4
+
+/* No. of segments that can be in flight at once; the ethernet controller's free buffer is
+   divided among them */
+#define SERIALD_WINDOW          4
+
 void seriald_init(void);
+void seriald_configure(void);
+void seriald_autobaud(void);
 void seriald_shutdown(void);
 void seriald_disconnect(void);
 bool seriald_shouldtransfer(void);
-void seriald_switchbuffers(void);
 void seriald_transfer(void);
+struct uip_conn *seriald_flush(void);
+struct uip_udp_conn *seriald_udpflush(void);
 void seriald_appcall(void);
+void seriald_udpappcall(void);
 
-void seriald_incoming(const unsigned char c);
-void seriald_dropped(void);
+void seriald_int_rx(void);
 
 void seriald_connected(void);
 void seriald_disconnected(void);
 void seriald_received(const char* data, const unsigned int length);
+bool seriald_receivebusy(void);
 
 typedef struct {
     unsigned int retransmitted,
                  net_dropped,
                  uart_dropped,
+                 serial_dropped,
                  controller_full;
 } seriald_statistics_t;
 
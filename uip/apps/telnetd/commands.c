@@ -24,6 +24,7 @@
 #include "uip.h"
 #include "../dhcpc/dhcpc.h"
 #include "../seriald/seriald.h"
+#include "ssp.h"
 
 const commandentry_t commands[] = {
     {"ls",      command_ls},
@@ -34,6 +35,7 @@ const commandentry_t commands[] = {
     {"ip",      command_ip},
     {"gw",      command_gw},
     {"netstat", command_netstat},
+    {"perf",    command_perf},
 
     {"write",   command_write},
     {"reboot",  command_reboot},
@@ -113,10 +115,19 @@ void command_cat(char *str)
 void command_seriald(char *str)
 {
     extern seriald_statistics_t seriald_statistics;
+    static const char hexdigits[] = "0123456789abcdef";
     unsigned char i;
     char *line;
+    char hex[9];
 
-    if(strncmp(str, "seriald baud ", 13) == 0) {
+    if(strncmp(str, "seriald baud auto", 17) == 0) {
+        /* 'seriald baud auto [errors]'; measure it now, and again after that many framing errors */
+        settings.serial_autobaud = str[17] == ' ' ? strtoint(&str[18], 10) : SERIALD_AUTOBAUD_ERRORS;
+        seriald_autobaud();
+    }
+    else if(strncmp(str, "seriald baud ", 13) == 0) {
+        /* A fixed baudrate, no measuring */
+        settings.serial_autobaud = 0;
         if(strcmp(&str[13], "300") == 0) {
             settings.serial_baudrate = SERIAL_BAUDRATE_300;
         }
@@ -147,6 +158,12 @@ void command_seriald(char *str)
         else if(strcmp(&str[13], "230400") == 0) {
             settings.serial_baudrate = SERIAL_BAUDRATE_230400;
         }
+        else if(strcmp(&str[13], "460800") == 0) {
+            settings.serial_baudrate = SERIAL_BAUDRATE_460800;
+        }
+        else if(strcmp(&str[13], "921600") == 0) {
+            settings.serial_baudrate = SERIAL_BAUDRATE_921600;
+        }
         else {
             shell_output("Undefined baudrate\n\r");
         }
@@ -166,6 +183,26 @@ void command_seriald(char *str)
         settings.network_mode |= NETWORK_MODE_TCP;
         seriald_init();
     }
+    else if(strcmp(str, "seriald peer any") == 0) {
+        seriald_shutdown();
+        settings.network_peer[0] = 0;
+        settings.network_peer[1] = 0;
+        settings.network_peer[2] = 0;
+        settings.network_peer[3] = 0;
+        settings.network_peerport = 0;
+        seriald_init();
+    }
+    else if(strlen(str) > 29 && strncmp(str, "seriald peer ", 13) == 0 &&
+            str[16] == '.' && str[20] == '.' && str[24] == '.' && str[28] == ':') {
+        /* command 'seriald peer xxx.xxx.xxx.xxx:port' */
+        seriald_shutdown();
+        settings.network_peer[0] = strtoint(&str[13], 10);
+        settings.network_peer[1] = strtoint(&str[17], 10);
+        settings.network_peer[2] = strtoint(&str[21], 10);
+        settings.network_peer[3] = strtoint(&str[25], 10);
+        settings.network_peerport = strtoint(&str[29], 10);
+        seriald_init();
+    }
     else if(strncmp(str, "seriald parity ", 15) == 0 && strlen(str) == 16) {
         switch(str[15]) {
             case 'n':
@@ -196,17 +233,49 @@ void command_seriald(char *str)
                 settings.serial_mode |= SERIAL_MODE_FLOWCONTROL_RTSCTS;
                 break;
             case 's':
-                settings.serial_mode &= ~SERIAL_MODE_FLOWCONTROL;
+                settings.serial_mode &= ~(SERIAL_MODE_FLOWCONTROL | SERIAL_MODE_ESCAPE);
                 settings.serial_mode |= SERIAL_MODE_FLOWCONTROL_XONXOFF;
                 break;
+            case 'e':
+                settings.serial_mode &= ~SERIAL_MODE_FLOWCONTROL;
+                settings.serial_mode |= SERIAL_MODE_FLOWCONTROL_XONXOFF | SERIAL_MODE_ESCAPE;
+                break;
             default:
                 shell_output("Undefined flowcontrol\n\r");
                 break;
         }
+        seriald_configure();
+    }
+    else if(strncmp(str, "seriald gap ", 12) == 0) {
+        settings.serial_idlegap = strtoint(&str[12],10);
+        seriald_configure();
+    }
+    else if(strncmp(str, "seriald latency ", 16) == 0) {
+        settings.serial_maxlatency = strtoint(&str[16],10);
+        seriald_configure();
+    }
+    else if(strncmp(str, "seriald fill ", 13) == 0) {
+        settings.serial_minfill = strtoint(&str[13],10);
+        seriald_configure();
+    }
+    else if(strcmp(str, "seriald delimiter none") == 0) {
+        settings.serial_delimiterlength = 0;
+        seriald_configure();
+    }
+    else if(strncmp(str, "seriald delimiter ", 18) == 0 && strlen(str) % 2 == 0 && strlen(str) <= 18 + 2 * sizeof(settings.serial_delimiter)) {
+        /* One to four bytes, in hex */
+        for(i=0;str[18 + 2*i];i++) {
+            hex[0] = str[18 + 2*i];
+            hex[1] = str[18 + 2*i + 1];
+            hex[2] = '\0';
+            settings.serial_delimiter[i] = strtoint(hex, 16);
+        }
+        settings.serial_delimiterlength = i;
+        seriald_configure();
     }
     else if(strcmp(str, "seriald statistics") == 0) {
         shell_output("ReTx:%d, Controller full:%d\n\r", seriald_statistics.retransmitted, seriald_statistics.controller_full);
-        shell_output("Dropped uart:%d, net:%d\n\r", seriald_statistics.uart_dropped, seriald_statistics.net_dropped);
+        shell_output("Dropped uart:%d, net:%d, serial:%d\n\r", seriald_statistics.uart_dropped, seriald_statistics.net_dropped, seriald_statistics.serial_dropped);
     } 
     else if(strlen(str) == 7) {
         if((line = telnetd_getline()) != NULL) {
@@ -241,11 +310,22 @@ void command_seriald(char *str)
                 case SERIAL_BAUDRATE_230400:
                     i = sprintf(line, "230400");
                     break;
+                case SERIAL_BAUDRATE_460800:
+                    i = sprintf(line, "460800");
+                    break;
+                case SERIAL_BAUDRATE_921600:
+                    i = sprintf(line, "921600");
+                    break;
                 default:
-                    i = sprintf(line, "?");
+                    /* Measured */
+                    i = sprintf(line, "%ld", (long)(CCLK / 4 / ((unsigned long)settings.serial_baudrate + 1)));
                     break;
             }
-            i += sprintf(&line[i], " baud, port %d ", settings.network_port);
+            i += sprintf(&line[i], " baud");
+            if(settings.serial_autobaud) {
+                i += sprintf(&line[i], " (auto, %d errors)", (int)settings.serial_autobaud);
+            }
+            i += sprintf(&line[i], ", port %d ", settings.network_port);
             if(network_mode_tcp()) {
                 i += sprintf(&line[i], "TCP");
             }
@@ -259,6 +339,9 @@ void command_seriald(char *str)
             else if(serial_flowcontrol_rtscts()) {
                 i += sprintf(&line[i], "hw");
             }   
+            else if(serial_flowcontrol_escaped()) {
+                i += sprintf(&line[i], "sw, escaped");
+            }
             else if(serial_flowcontrol_xonxoff() ) {
                 i += sprintf(&line[i], "sw");
             }
@@ -282,11 +365,35 @@ void command_seriald(char *str)
 
             telnetd_sendline(line);
         }
+        shell_output("Send after %d chars idle, %d ms, or fill %d\n\r", (int)settings.serial_idlegap, settings.serial_maxlatency, (int)settings.serial_minfill);
+        if(settings.serial_delimiterlength) {
+            for(i=0;i<settings.serial_delimiterlength;i++) {
+                hex[2*i] = hexdigits[settings.serial_delimiter[i] >> 4];
+                hex[2*i + 1] = hexdigits[settings.serial_delimiter[i] & 0x0F];
+            }
+            hex[2*i] = '\0';
+            shell_output("Records end with %s\n\r", hex);
+        }
+        if(network_mode_udp()) {
+            if(settings.network_peer[0] == 0 && settings.network_peer[1] == 0 && settings.network_peer[2] == 0 && settings.network_peer[3] == 0) {
+                shell_output("Datagrams go to the last sender\n\r");
+            }
+            else {
+                shell_output("Datagrams go to %d.%d.%d.%d:%d\n\r", (int)settings.network_peer[0],
+                                                                  (int)settings.network_peer[1],
+                                                                  (int)settings.network_peer[2],
+                                                                  (int)settings.network_peer[3],
+                                                                  settings.network_peerport);
+            }
+        }
     }
     else {
-        shell_output("Use one off 'seriald baud x', 'seriald port x',\n\r");
-        shell_output("'seriald udp/tcp', 'seriald parity n/o/e' or\n\r");
-        shell_output("'seriald flow n/h/s'.\n\r");
+        shell_output("Use one off 'seriald baud x/auto [errors]', 'seriald port x',\n\r");
+        shell_output("'seriald udp/tcp', 'seriald parity n/o/e',\n\r");
+        shell_output("'seriald peer xxx.xxx.xxx.xxx:port/any' (udp),\n\r");
+        shell_output("'seriald flow n/h/s/e', 'seriald gap x' (chars),\n\r");
+        shell_output("'seriald latency x' (ms), 'seriald fill x' or\n\r");
+        shell_output("'seriald delimiter xx[xx[xx[xx]]]/none' (hex).\n\r");
     }
 }
 
@@ -397,6 +504,36 @@ void command_netstat(char *str)
     #endif
 }
 
+void command_perf(char *str)
+{
+    #if SSP_PROFILE
+    static const char *classes[SSP_CLASSES] = { "ENC28J60 registers", "ENC28J60 buffer", "EEPROM", "SD card" };
+    unsigned char i;
+    char *line;
+
+    if(strcmp(str, "perf reset") == 0) {
+        ssp_profile_reset();
+        shell_output("ok\n\r");
+    }
+    else if(strlen(str) == 4) {
+        /* Bytes and bus time, in microseconds, per subsystem */
+        for(i=0;i<SSP_CLASSES;i++) {
+            if((line = telnetd_getline()) != NULL) {
+                sprintf(line, "%s: %lu bytes, %lu us\n\r", classes[i], ssp_profile[i].bytes, ssp_profile[i].cycles / (CCLK/4/1000000));
+                telnetd_sendline(line);
+            }
+        }
+    }
+    else {
+        shell_output("Use 'perf' to show SPI usage, 'perf reset' to clear.\n\r");
+    }
+    #else
+    (void)str;
+
+    shell_output("Profiling disabled\n\r");
+    #endif
+}
+
 void command_write(char *str)
 {
     (void)str;
@@ -439,6 +576,7 @@ void command_help(char *str)
     shell_output("ip\n\r");
     shell_output("gw\n\r");
     shell_output("netstat\n\r");
+    shell_output("perf\n\r");
 
     shell_output("reboot\n\r");
     shell_output("version\n\r");
@@ -31,6 +31,7 @@ void command_seriald(char *str);
 void command_ip(char *str);
 void command_gw(char *str);
 void command_netstat(char *str);
+void command_perf(char *str);
 void command_write(char *str);
 void command_reboot(char *str);
 void command_version(char *str);
@@ -119,11 +119,12 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_UDP             1
 
 /**
- * Maximum number of UDP connections.
+ * Maximum number of UDP connections; one for DHCP, two for seriald in
+ * UDP mode.
  *
  * \hideinitializer
  */
-#define UIP_CONF_UDP_CONNS       2
+#define UIP_CONF_UDP_CONNS       3
 
 /**
  * UDP checksums on or off
@@ -157,6 +158,42 @@ typedef unsigned short uip_stats_t;
 #define UIP_SPLIT                1
 #define UIP_SPLIT_CONF_SIZE      100
 //(NETWORK_MAXPACKETLENGTH / 2)
+#define UIP_SPLIT_CONF_INCONTROLLER_GAP TXSTATUSVECTORLENGTH // as defined in enc28j60.h
+
+/**
+ * When enabled, a connection can have several segments in flight as
+ * long as their payload stays in the ethernet controller RAM (that
+ * is, sent with uip_send() and a NULL-pointer); see uip_cansend().
+ *
+ * \hideinitializer
+ */
+#define UIP_SLIDING_WINDOW       1
+
+/**
+ * When enabled, the ACK for a received segment waits up to UIP_ACK_DELAY
+ * ms, to go along with data from the application or to cover the next
+ * segment as well. Segments of half the receive window or more are
+ * still ACK'd right away; the peer can't send anything else until then.
+ *
+ * \hideinitializer
+ */
+#define UIP_DELAYED_ACK          1
+
+/**
+ * Fast retransmit after this many duplicate ACKs. seriald has no more
+ * than SERIALD_WINDOW (4) segments in flight, so after a lost one
+ * there are often fewer than the usual 3 to come.
+ *
+ * \hideinitializer
+ */
+#define UIP_CONF_DUPACKS         2
+
+/**
+ * The retransmission timers run off systick(), every 10 ms
+ *
+ * \hideinitializer
+ */
+#define UIP_CONF_FAST_TIMER_INTERVAL 10
 
 /* Here we include the header file for the application(s) we use in
    our project. */
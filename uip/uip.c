@@ -136,11 +136,6 @@ u8_t uip_buf[UIP_BUFSIZE + 2];   /* The packet buffer that contains incoming pac
 void *uip_appdata;               /* The uip_appdata pointer points to application data. */
 void *uip_sappdata;              /* The uip_appdata pointer points to the application data which is to be sent. */
 
-u16_t uip_tcpchksum_incontroller_1, uip_tcpchksum_incontroller_2;   
-                                 /* For applications that want to assemble a TCP packet directly in the
-                                    ethernet controller RAM, checksum is calulated by the application and
-                                    stored here */
-u16_t uip_chksum_singlebytes;    /* Used in uip_chksum_byte() */
 
 #if UIP_URGDATA > 0
 void *uip_urgdata;               /* The uip_urgdata pointer points to urgent data (out-of-band data), if present. */
@@ -148,6 +143,8 @@ u16_t uip_urglen, uip_surglen;
 #endif /* UIP_URGDATA > 0 */
 
 u16_t uip_len, uip_slen;        /* The uip_len is either 8 or 16 bits, depending on the maximum packet size. */
+u16_t uip_acklen;               /* No. of bytes acknowledged, when UIP_ACKDATA is set */
+u8_t uip_incontroller_rx;       /* Payload of the received packet is still in the ethernet controller */
 
 u8_t uip_flags;                 /* The uip_flags variable is used for communication between the TCP/IP stack
                                    and the application program. */
@@ -177,6 +174,13 @@ u8_t uip_acc32[4];
 static u8_t c, opt;
 static u16_t tmp16;
 
+#if UIP_SLIDING_WINDOW
+/* The application can send more while there's data in flight, when that's all in the ethernet controller */
+#define uip_pollable(conn) (!uip_outstanding(conn) || (conn)->incontroller)
+#else /* UIP_SLIDING_WINDOW */
+#define uip_pollable(conn) (!uip_outstanding(conn))
+#endif /* UIP_SLIDING_WINDOW */
+
 /* Structures and definitions. */
 #define TCP_FIN 0x01
 #define TCP_SYN 0x02
@@ -279,63 +283,6 @@ u16_t chksum(u16_t sum, const u8_t *data, u16_t len)
     return sum;
 }
 
-u16_t uip_chksum_bytes(u16_t sum, const u8_t *data, u16_t len)
-{
-    u16_t t;
-    const u8_t *dataptr;
-    const u8_t *last_byte;
-
-    if(len == 1) {
-        if(uip_chksum_singlebytes&1) {
-            sum += data[0];
-            if(sum < data[0]) {
-                sum++;
-            }
-        }
-        else {
-            t = data[0] << 8;
-            sum += t;
-            if(sum < t) {
-                sum++;
-            }
-        }
-        uip_chksum_singlebytes++;
-    }
-    else {
-		dataptr = data;
-		last_byte = data + len - 1;
-		
-        if(uip_chksum_singlebytes&1) {
-            sum += data[0];
-            if(sum < data[0]) {
-                sum++;
-            }
-			dataptr++;
-        }
-		uip_chksum_singlebytes += len;
-		
-		while(dataptr < last_byte) {    /* At least two more bytes */
-			t = (dataptr[0] << 8) + dataptr[1];
-			sum += t;
-			if(sum < t) {
-				sum++;  /* carry */
-			}
-			dataptr += 2;
-		}
-
-		if(dataptr == last_byte) {
-			/* Length of data is odd, add a zero padding byte */
-			t = (dataptr[0] << 8) + 0;
-			sum += t;
-			if(sum < t) {
-				sum++;  /* carry */
-			}
-		}
-    }
-	
-	return sum;
-}
-
 u16_t uip_chksum(u16_t *data, u16_t len)
 {
     return htons(chksum(0, (u8_t *)data, len));
@@ -397,6 +344,30 @@ u16_t uip_udpchksum(void)
 #endif /* UIP_UDP_CHECKSUMS */
 #endif /* ! UIP_ARCH_CHKSUM */
 
+#if !UIP_CONF_IPV6
+static u16_t uip_tcpchksum_incontroller_rx(void)
+{
+    u16_t upper_layer_len;
+    u16_t sum, payload;
+
+    upper_layer_len = (((u16_t)(BUF->len[0]) << 8) + BUF->len[1]) - UIP_IPH_LEN;
+
+    /* Pseudoheader and TCP header, as upper_layer_chksum() does. */
+    sum = upper_layer_len + UIP_PROTO_TCP;
+    sum = chksum(sum, (u8_t *)&BUF->srcipaddr[0], 2 * sizeof(uip_ipaddr_t));
+    sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN], UIP_TCPH_LEN);
+
+    /* The header has an even length, so the payload sum can simply be added. */
+    payload = uip_chksum_incontroller_rx(upper_layer_len - UIP_TCPH_LEN);
+    sum += payload;
+    if(sum < payload) {
+        sum++;
+    }
+
+    return (sum == 0) ? 0xffff : htons(sum);
+}
+#endif /* !UIP_CONF_IPV6 */
+
 void uip_init(void)
 {
     for(c = 0; c < UIP_LISTENPORTS; ++c) {
@@ -414,9 +385,6 @@ void uip_init(void)
         uip_udp_conns[c].lport = 0;
     }
     #endif /* UIP_UDP */
-    uip_tcpchksum_incontroller_1 = 0;
-    uip_tcpchksum_incontroller_2 = 0;
-    uip_chksum_singlebytes = 0;
 }
 
 #if UIP_ACTIVE_OPEN
@@ -475,7 +443,20 @@ again:
     conn->timer = 1; /* Send the SYN next time around. */
     conn->rto = UIP_RTO;
     conn->sa = 0;
-    conn->sv = 16;   /* Initial value of the RTT variance. */
+    conn->sv = 0;    /* Both zero until the first RTT measurement. */
+    conn->rtttimed = 0;
+#if UIP_SLIDING_WINDOW
+    conn->incontroller = 0;
+    conn->dupacks = 0;
+    conn->wnd = 0;   /* Known once the SYNACK is in. */
+#endif /* UIP_SLIDING_WINDOW */
+#if UIP_DELAYED_ACK
+    conn->unacked = 0;
+    conn->ackdelay = 0;
+#endif /* UIP_DELAYED_ACK */
+#if UIP_SPLIT
+    conn->hdrsum = 0;
+#endif /* UIP_SPLIT */
     conn->lport = htons(lastport);
     conn->rport = rport;
     uip_ipaddr_copy(&conn->ripaddr, ripaddr);
@@ -524,6 +505,9 @@ again:
         uip_ipaddr_copy(&conn->ripaddr, ripaddr);
     }
     conn->ttl = UIP_TTL;
+#if UIP_SPLIT
+    conn->hdrsum = 0;
+#endif /* UIP_SPLIT */
 
     return conn;
 }
@@ -675,6 +659,17 @@ static void uip_add_rcv_nxt(u16_t n)
     uip_conn->rcv_nxt[3] = uip_acc32[3];
 }
 
+static void uip_rtt_start(void)
+{
+    /* Time the segment that was just added to the outstanding data, unless
+       one is timed already. */
+    if(!uip_conn->rtttimed) {
+        uip_conn->rtttimed = 1;
+        uip_conn->rtt = 0;
+        uip_conn->rttseq = (((u16_t)uip_conn->snd_nxt[2] << 8) | uip_conn->snd_nxt[3]) + uip_conn->len;
+    }
+}
+
 void uip_process(u8_t flag)
 {
     register struct uip_conn *uip_connr = uip_conn;
@@ -690,7 +685,7 @@ void uip_process(u8_t flag)
     /* Check if we were invoked because of a poll request for a particular connection. */
     if(flag == UIP_POLL_REQUEST) {
         UIP_DEBUG("uip_process(): poll request\n\r");
-        if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED && !uip_outstanding(uip_connr)) {
+        if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED && uip_pollable(uip_connr)) {
             uip_flags = UIP_POLL;
             UIP_APPCALL();
             goto appsend;
@@ -727,66 +722,108 @@ void uip_process(u8_t flag)
             }
         }
         else if(uip_connr->tcpstateflags != UIP_CLOSED) {
-            /* If the connection has outstanding data, we increase the
-               connection's timer and see if it has reached the RTO value
-               in which case we retransmit. */
-            if(uip_outstanding(uip_connr)) {
-                if(uip_connr->timer-- == 0) {
-                    if(uip_connr->nrtx == UIP_MAXRTX || ((uip_connr->tcpstateflags == UIP_SYN_SENT || uip_connr->tcpstateflags == UIP_SYN_RCVD) &&  uip_connr->nrtx == UIP_MAXSYNRTX)) {
-                        uip_connr->tcpstateflags = UIP_CLOSED;
-
-                        /* We call UIP_APPCALL() with uip_flags set to UIP_TIMEDOUT to inform the application that the connection has timed out. */
-                        uip_flags = UIP_TIMEDOUT;
-                        UIP_APPCALL();
+            /* Retransmissions are up to uip_fastperiodic(); if there's nothing
+               in flight, we poll the application for new data. */
+            if(uip_pollable(uip_connr) && (uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+                uip_flags = UIP_POLL;
+                UIP_APPCALL();
+                goto appsend;
+            }
+        }
+        goto drop;
+    }
+    /* Check if we were invoked because of the retransmission timer fireing. */
+    else if(flag == UIP_FAST_TIMER) {
+        uip_len = 0;
+        uip_slen = 0;
 
-                        /* We also send a reset packet to the remote host. */
-                        BUF->flags = TCP_RST | TCP_ACK;
-                        goto tcp_send_nodata;
-                    }
+#if UIP_DELAYED_ACK
+        if(uip_connr->ackdelay != 0) {
+            if(uip_connr->ackdelay > UIP_FAST_TIMER_INTERVAL) {
+                uip_connr->ackdelay -= UIP_FAST_TIMER_INTERVAL;
+            }
+            else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+                /* Nothing came along to take the delayed ACK; it goes by itself */
+                uip_flags = 0;
+                goto tcp_send_ack;
+            }
+            else {
+                uip_connr->ackdelay = 0;
+            }
+        }
+#endif /* UIP_DELAYED_ACK */
+
+        if(uip_connr->tcpstateflags != UIP_CLOSED && uip_connr->tcpstateflags != UIP_TIME_WAIT &&
+           uip_connr->tcpstateflags != UIP_FIN_WAIT_2 && uip_outstanding(uip_connr)) {
+            /* Time the segment of which we're waiting for the ACK to
+               measure the RTT. Keep it within what the estimation in
+               uip_process() can handle. */
+            if(uip_connr->rtttimed && uip_connr->rtt < 4000) {
+                uip_connr->rtt += UIP_FAST_TIMER_INTERVAL;
+            }
 
-                    /* Exponential backoff. */
-                    uip_connr->timer = UIP_RTO << (uip_connr->nrtx > 4?
-                                    4:
-                                    uip_connr->nrtx);
-                    (uip_connr->nrtx)++;
-
-                    /* Ok, so we need to retransmit. We do this differently
-                       depending on which state we are in. In ESTABLISHED, we
-                       call upon the application so that it may prepare the
-                       data for the retransmit. In SYN_RCVD, we resend the
-                       SYNACK that we sent earlier and in LAST_ACK we have to
-                       retransmit our FINACK. */
-                    UIP_STAT(++uip_stat.tcp.rexmit);
-                    switch(uip_connr->tcpstateflags & UIP_TS_MASK) {
-                        case UIP_SYN_RCVD:  /* In the SYN_RCVD state, we should retransmit ourSYNACK. */
-                            goto tcp_send_synack;
+            /* The connection has outstanding data, we decrease the
+               connection's timer and see if it has run out in which case
+               we retransmit. */
+            if(uip_connr->timer > UIP_FAST_TIMER_INTERVAL) {
+                uip_connr->timer -= UIP_FAST_TIMER_INTERVAL;
+            }
+            else {
+                if(uip_connr->nrtx == UIP_MAXRTX || ((uip_connr->tcpstateflags == UIP_SYN_SENT || uip_connr->tcpstateflags == UIP_SYN_RCVD) &&  uip_connr->nrtx == UIP_MAXSYNRTX)) {
+                    uip_connr->tcpstateflags = UIP_CLOSED;
+
+                    /* We call UIP_APPCALL() with uip_flags set to UIP_TIMEDOUT to inform the application that the connection has timed out. */
+                    uip_flags = UIP_TIMEDOUT;
+                    UIP_APPCALL();
+
+                    /* We also send a reset packet to the remote host. */
+                    BUF->flags = TCP_RST | TCP_ACK;
+                    goto tcp_send_nodata;
+                }
+
+                /* Exponential backoff. The RTO stays backed off until an
+                   ACK for a segment that wasn't retransmitted gives us a
+                   new RTT measurement (Karn). */
+                if(uip_connr->rto < UIP_RTO_MAX / 2) {
+                    uip_connr->rto <<= 1;
+                }
+                else {
+                    uip_connr->rto = UIP_RTO_MAX;
+                }
+                uip_connr->timer = uip_connr->rto;
+                uip_connr->rtttimed = 0;
+                (uip_connr->nrtx)++;
+
+                /* Ok, so we need to retransmit. We do this differently
+                   depending on which state we are in. In ESTABLISHED, we
+                   call upon the application so that it may prepare the
+                   data for the retransmit. In SYN_RCVD, we resend the
+                   SYNACK that we sent earlier and in LAST_ACK we have to
+                   retransmit our FINACK. */
+                UIP_STAT(++uip_stat.tcp.rexmit);
+                switch(uip_connr->tcpstateflags & UIP_TS_MASK) {
+                    case UIP_SYN_RCVD:  /* In the SYN_RCVD state, we should retransmit ourSYNACK. */
+                        goto tcp_send_synack;
     #if UIP_ACTIVE_OPEN
-                        case UIP_SYN_SENT:  /* In the SYN_SENT state, we retransmit out SYN. */
-                            BUF->flags = 0;
-                            goto tcp_send_syn;
+                    case UIP_SYN_SENT:  /* In the SYN_SENT state, we retransmit out SYN. */
+                        BUF->flags = 0;
+                        goto tcp_send_syn;
     #endif /* UIP_ACTIVE_OPEN */
-                        case UIP_ESTABLISHED:
-                            /* In the ESTABLISHED state, we call upon the application
-                               to do the actual retransmit after which we jump into
-                               the code for sending out the packet (the apprexmit
-                               label). */
-                            uip_flags = UIP_REXMIT;
-                            UIP_APPCALL();
-                            goto apprexmit;
-                        case UIP_FIN_WAIT_1:
-                        case UIP_CLOSING:
-                        case UIP_LAST_ACK:
-                            /* In all these states we should retransmit a FINACK. */
-                            goto tcp_send_finack;
-                    }
+                    case UIP_ESTABLISHED:
+                        /* In the ESTABLISHED state, we call upon the application
+                           to do the actual retransmit after which we jump into
+                           the code for sending out the packet (the apprexmit
+                           label). */
+                        uip_flags = UIP_REXMIT;
+                        UIP_APPCALL();
+                        goto apprexmit;
+                    case UIP_FIN_WAIT_1:
+                    case UIP_CLOSING:
+                    case UIP_LAST_ACK:
+                        /* In all these states we should retransmit a FINACK. */
+                        goto tcp_send_finack;
                 }
             }
-            else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
-                /* If there was no need for a retransmission, we poll the application for new data. */
-                uip_flags = UIP_POLL;
-                UIP_APPCALL();
-                goto appsend;
-            }
         }
         goto drop;
     }
@@ -1134,13 +1171,16 @@ udp_send:
     uip_ipaddr_copy(BUF->srcipaddr, uip_hostaddr);
     uip_ipaddr_copy(BUF->destipaddr, uip_udp_conn->ripaddr);
 
-    uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_IPTCPH_LEN];
+    uip_appdata = uip_sappdata;
 
 #if UIP_UDP_CHECKSUMS
-    /* Calculate UDP checksum. */
-    UDPBUF->udpchksum = ~(uip_udpchksum());
-    if(UDPBUF->udpchksum == 0) {
-        UDPBUF->udpchksum = 0xffff;
+    /* Calculate UDP checksum. Skip calculation if the payload is already in the ethernet
+       controller RAM; uip_split_output() takes care of it */
+    if(uip_appdata != NULL) {
+        UDPBUF->udpchksum = ~(uip_udpchksum());
+        if(UDPBUF->udpchksum == 0) {
+            UDPBUF->udpchksum = 0xffff;
+        }
     }
 #endif /* UIP_UDP_CHECKSUMS */
     goto ip_send_nolen;
@@ -1152,6 +1192,17 @@ tcp_input:
 
     /* Start of TCP input header processing code. */
 
+#if !UIP_CONF_IPV6
+    if(uip_incontroller_rx) {
+        if(uip_tcpchksum_incontroller_rx() != 0xffff) {   /* Same, with the payload in the ethernet controller. */
+            UIP_STAT(++uip_stat.tcp.drop);
+            UIP_STAT(++uip_stat.tcp.chkerr);
+            UIP_LOG("tcp: bad checksum.");
+            goto drop;
+        }
+    }
+    else
+#endif /* !UIP_CONF_IPV6 */
     if(uip_tcpchksum() != 0xffff) {   /* Compute and check the TCP checksum. */
         UIP_STAT(++uip_stat.tcp.drop);
         UIP_STAT(++uip_stat.tcp.chkerr);
@@ -1277,8 +1328,21 @@ found_listen:
     /* Fill in the necessary fields for the new connection. */
     uip_connr->rto = uip_connr->timer = UIP_RTO;
     uip_connr->sa = 0;
-    uip_connr->sv = 4;
+    uip_connr->sv = 0;
+    uip_connr->rtttimed = 0;
     uip_connr->nrtx = 0;
+#if UIP_SLIDING_WINDOW
+    uip_connr->incontroller = 0;
+    uip_connr->dupacks = 0;
+    uip_connr->wnd = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+#endif /* UIP_SLIDING_WINDOW */
+#if UIP_DELAYED_ACK
+    uip_connr->unacked = 0;
+    uip_connr->ackdelay = 0;
+#endif /* UIP_DELAYED_ACK */
+#if UIP_SPLIT
+    uip_connr->hdrsum = 0;
+#endif /* UIP_SPLIT */
     uip_connr->lport = BUF->destport;
     uip_connr->rport = BUF->srcport;
     uip_ipaddr_copy(uip_connr->ripaddr, BUF->srcipaddr);
@@ -1390,7 +1454,18 @@ found:
        the outstanding data, calculate RTT estimations, and reset the
        retransmission timer. */
     if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
-        uip_add32(uip_connr->snd_nxt, uip_connr->len);
+        uip_acklen = uip_connr->len;
+#if UIP_SLIDING_WINDOW
+        if(uip_connr->incontroller) {
+            /* There can be several segments in flight, an ACK for any part of them will do.
+               Less than 64K is outstanding, so the lower half of the numbers tells how much */
+            tmp16 = (((u16_t)BUF->ackno[2] << 8) | BUF->ackno[3]) - (((u16_t)uip_connr->snd_nxt[2] << 8) | uip_connr->snd_nxt[3]);
+            if(tmp16 != 0 && tmp16 < uip_acklen) {
+                uip_acklen = tmp16;
+            }
+        }
+#endif /* UIP_SLIDING_WINDOW */
+        uip_add32(uip_connr->snd_nxt, uip_acklen);
 
         if(BUF->ackno[0] == uip_acc32[0] && BUF->ackno[1] == uip_acc32[1] && BUF->ackno[2] == uip_acc32[2] && BUF->ackno[3] == uip_acc32[3]) {
             /* Update sequence number. */
@@ -1400,28 +1475,71 @@ found:
             uip_connr->snd_nxt[3] = uip_acc32[3];
 
 
-            /* Do RTT estimation, unless we have done retransmissions. */
-            if(uip_connr->nrtx == 0) {
-                signed char m;
-                m = uip_connr->rto - uip_connr->timer;
-                /* This is taken directly from VJs original code in his paper */
-                m = m - (uip_connr->sa >> 3);
-                uip_connr->sa += m;
-                if(m < 0) {
-                    m = -m;
+            /* Do RTT estimation, once the timed segment is acknowledged. It
+               wasn't retransmitted, or it wouldn't be timed anymore. */
+            if(uip_connr->rtttimed && (signed short)((((u16_t)uip_connr->snd_nxt[2] << 8) | uip_connr->snd_nxt[3]) - uip_connr->rttseq) >= 0) {
+                signed short m;
+                uip_connr->rtttimed = 0;
+                m = uip_connr->rtt;
+                if(uip_connr->sa == 0 && uip_connr->sv == 0) {
+                    /* First measurement (RFC 6298) */
+                    uip_connr->sa = m << 3;
+                    uip_connr->sv = m << 1;
+                }
+                else {
+                    /* This is taken directly from VJs original code in his paper */
+                    m = m - (uip_connr->sa >> 3);
+                    uip_connr->sa += m;
+                    if(m < 0) {
+                        m = -m;
+                    }
+                    m = m - (uip_connr->sv >> 2);
+                    uip_connr->sv += m;
+                }
+                /* The deviation counts for at least one timer interval */
+                uip_connr->rto = (uip_connr->sa >> 3) + (uip_connr->sv > UIP_FAST_TIMER_INTERVAL? uip_connr->sv: UIP_FAST_TIMER_INTERVAL);
+                if(uip_connr->rto < UIP_RTO_MIN) {
+                    uip_connr->rto = UIP_RTO_MIN;
                 }
-                m = m - (uip_connr->sv >> 2);
-                uip_connr->sv += m;
-                uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
             }
             /* Set the acknowledged flag. */
             uip_flags = UIP_ACKDATA;
             /* Reset the retransmission timer. */
             uip_connr->timer = uip_connr->rto;
 
+#if UIP_SLIDING_WINDOW
+            /* Whatever's left is still in flight */
+            uip_connr->dupacks = 0;
+            uip_connr->len -= uip_acklen;
+            if(uip_connr->len == 0) {
+                uip_connr->incontroller = 0;
+            }
+            else {
+                uip_connr->nrtx = 0;
+            }
+#else /* UIP_SLIDING_WINDOW */
             /* Reset length of outstanding data. */
             uip_connr->len = 0;
+#endif /* UIP_SLIDING_WINDOW */
+        }
+#if UIP_SLIDING_WINDOW
+        else if(uip_connr->incontroller && uip_len == 0 && (BUF->flags & (TCP_SYN | TCP_FIN)) == 0 &&
+                BUF->ackno[0] == uip_connr->snd_nxt[0] && BUF->ackno[1] == uip_connr->snd_nxt[1] &&
+                BUF->ackno[2] == uip_connr->snd_nxt[2] && BUF->ackno[3] == uip_connr->snd_nxt[3] &&
+                (((u16_t)BUF->wnd[0] << 8) | BUF->wnd[1]) == uip_connr->wnd) {
+            /* A duplicate ACK; the peer got a segment, but not the oldest one
+               in flight. After a few, retransmit that one right away, without
+               the backoff of a timeout. Further ones won't do it again, the
+               count stops there; the ACK for the retransmission tells what
+               else is missing. */
+            if(uip_connr->dupacks < UIP_DUPACKS && ++(uip_connr->dupacks) == UIP_DUPACKS) {
+                uip_connr->timer = uip_connr->rto;
+                uip_connr->rtttimed = 0;
+                UIP_STAT(++uip_stat.tcp.rexmit);
+                uip_flags = UIP_REXMIT;
+            }
         }
+#endif /* UIP_SLIDING_WINDOW */
     }
 
     /* Do different things depending on in what state the connection is. */
@@ -1496,6 +1614,9 @@ found:
                 uip_add_rcv_nxt(1);
                 uip_flags = UIP_CONNECTED | UIP_NEWDATA;
                 uip_connr->len = 0;
+#if UIP_SLIDING_WINDOW
+                uip_connr->wnd = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+#endif /* UIP_SLIDING_WINDOW */
                 uip_len = 0;
                 uip_slen = 0;
                 UIP_APPCALL();
@@ -1569,6 +1690,13 @@ tcp_send_finack:
             if(uip_len > 0 && !(uip_connr->tcpstateflags & UIP_STOPPED)) {
                 uip_flags |= UIP_NEWDATA;
                 uip_add_rcv_nxt(uip_len);
+                if(uip_incontroller_rx) {
+                    /* Not in uip_buf; tell the application it's still in the ethernet controller. */
+                    uip_appdata = NULL;
+                }
+#if UIP_DELAYED_ACK
+                uip_connr->unacked += uip_len;
+#endif /* UIP_DELAYED_ACK */
             }
 
             /* Check if the available buffer space advertised by the other end
@@ -1583,6 +1711,9 @@ tcp_send_finack:
                and the application will retransmit it. This is called the
                "persistent timer" and uses the retransmission mechanim. */
             tmp16 = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+#if UIP_SLIDING_WINDOW
+            uip_connr->wnd = tmp16;
+#endif /* UIP_SLIDING_WINDOW */
             if(tmp16 > uip_connr->initialmss || tmp16 == 0) {
                 tmp16 = uip_connr->initialmss;
             }
@@ -1604,6 +1735,15 @@ tcp_send_finack:
                put into the uip_appdata and the length of the data should be
                put into uip_len. If the application don't have any data to
                send, uip_len must be set to 0. */
+#if UIP_SLIDING_WINDOW
+            if(uip_flags == UIP_REXMIT) {
+                /* Fast retransmit; the application does it as for a
+                   retransmission timeout */
+                uip_slen = 0;
+                UIP_APPCALL();
+                goto apprexmit;
+            }
+#endif /* UIP_SLIDING_WINDOW */
             if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA)) {
                 uip_slen = 0;
                 UIP_APPCALL();
@@ -1619,6 +1759,9 @@ appsend:
                 if(uip_flags & UIP_CLOSE) {
                     uip_slen = 0;
                     uip_connr->len = 1;
+#if UIP_SLIDING_WINDOW
+                    uip_connr->incontroller = 0;
+#endif /* UIP_SLIDING_WINDOW */
                     uip_connr->tcpstateflags = UIP_FIN_WAIT_1;
                     uip_connr->nrtx = 0;
                     BUF->flags = TCP_FIN | TCP_ACK;
@@ -1626,13 +1769,27 @@ appsend:
                 }
 
                 /* If uip_slen > 0, the application has data to be sent. */
+#if UIP_SLIDING_WINDOW
+                if(uip_slen > 0 && (uip_flags & UIP_REXMIT)) {
+                    /* The oldest segment, again; see uip_resend() */
+                    goto apprexmit;
+                }
+#endif /* UIP_SLIDING_WINDOW */
                 if(uip_slen > 0) {
                     /* If the connection has acknowledged data, the contents of
                        the ->len variable should be discarded. */
-                    if((uip_flags & UIP_ACKDATA) != 0) {
+                    if((uip_flags & UIP_ACKDATA) != 0 && !uip_pollable(uip_connr)) {
                         uip_connr->len = 0;
                     }
 
+#if UIP_SLIDING_WINDOW
+                    if(uip_connr->len != 0 && uip_connr->incontroller && uip_sappdata == NULL) {
+                        /* Another segment, behind the ones in flight */
+                        uip_connr->len += uip_slen;
+                        uip_rtt_start();
+                    }
+                    else
+#endif /* UIP_SLIDING_WINDOW */
                     /* If the ->len variable is non-zero the connection has
                        already data in transit and cannot send anymore right now. */
                     if(uip_connr->len == 0) {
@@ -1646,6 +1803,10 @@ appsend:
                         /* Remember how much data we send out now so that we know
                            when everything has been acknowledged. */
                         uip_connr->len = uip_slen;
+#if UIP_SLIDING_WINDOW
+                        uip_connr->incontroller = (uip_sappdata == NULL);
+#endif /* UIP_SLIDING_WINDOW */
+                        uip_rtt_start();
                     }
                     else {
                         /* If the application already had unacknowledged data, we
@@ -1655,14 +1816,34 @@ appsend:
                     }
                     UIP_DEBUG("uip_slen=%d\n\r", uip_slen);
                 }
+#if UIP_SLIDING_WINDOW
+                /* Unless earlier segments are still in flight */
+                if(!uip_connr->incontroller || uip_connr->len == uip_slen) {
+                    uip_connr->nrtx = 0;
+                }
+#else /* UIP_SLIDING_WINDOW */
                 uip_connr->nrtx = 0;
+#endif /* UIP_SLIDING_WINDOW */
 apprexmit:
                 uip_appdata = uip_sappdata;
 
                 /* If the application has data to be sent, or if the incoming packet had new data in it, we must send out a packet. */
                 if(uip_slen > 0 && uip_connr->len > 0) {
                     /* Add the length of the IP and TCP headers. */
+#if UIP_SLIDING_WINDOW
+                    if(uip_connr->incontroller) {
+                        /* Just this segment; it's one of possibly several in flight */
+                        if(uip_slen > uip_connr->len) {
+                            uip_slen = uip_connr->len;
+                        }
+                        uip_len = uip_slen + UIP_TCPIP_HLEN;
+                    }
+                    else {
+                        uip_len = uip_connr->len + UIP_TCPIP_HLEN;
+                    }
+#else /* UIP_SLIDING_WINDOW */
                     uip_len = uip_connr->len + UIP_TCPIP_HLEN;
+#endif /* UIP_SLIDING_WINDOW */
                     /* We always set the ACK flag in response packets. */
                     BUF->flags = TCP_ACK | TCP_PSH;
                     /* Send the packet. */
@@ -1670,6 +1851,17 @@ apprexmit:
                 }
                 /* If there is no data to send, just send out a pure ACK if there is newdata. */
                 if(uip_flags & UIP_NEWDATA) {
+#if UIP_DELAYED_ACK
+                    /* Unless it's for less than half the window, and no ACK is
+                       waiting yet; then it waits for something to go along with,
+                       or for the next segment (RFC 1122, 4.2.3.2). A window update
+                       after uip_restart() and a zero window go out right away. */
+                    if(uip_connr->ackdelay == 0 && uip_connr->unacked != 0 && uip_connr->unacked < UIP_RECEIVE_WINDOW / 2 &&
+                       !(uip_connr->tcpstateflags & UIP_STOPPED)) {
+                        uip_connr->ackdelay = UIP_ACK_DELAY;
+                        goto drop;
+                    }
+#endif /* UIP_DELAYED_ACK */
                     uip_len = UIP_TCPIP_HLEN;
                     BUF->flags = TCP_ACK;
                     goto tcp_send_noopts;
@@ -1746,6 +1938,9 @@ apprexmit:
 tcp_send_ack:
     BUF->flags = TCP_ACK;
 tcp_send_nodata:
+    /* No payload; in particular not the received one that was left in the ethernet
+       controller (see uip_incontroller_rx), so uip_split_output() must not take it as such */
+    uip_appdata = &uip_buf[UIP_IPTCPH_LEN + UIP_LLH_LEN];
     uip_len = UIP_IPTCPH_LEN;
 tcp_send_noopts:
     BUF->tcpoffset = (UIP_TCPH_LEN / 4) << 4;
@@ -1754,6 +1949,11 @@ tcp_send:
        reply. Our job is to fill in all the fields of the TCP and IP
        headers before calculating the checksum and finally send the
        packet. */
+#if UIP_DELAYED_ACK
+    /* It acknowledges everything received so far */
+    uip_connr->unacked = 0;
+    uip_connr->ackdelay = 0;
+#endif /* UIP_DELAYED_ACK */
     BUF->ackno[0] = uip_connr->rcv_nxt[0];
     BUF->ackno[1] = uip_connr->rcv_nxt[1];
     BUF->ackno[2] = uip_connr->rcv_nxt[2];
@@ -1763,6 +1963,16 @@ tcp_send:
     BUF->seqno[1] = uip_connr->snd_nxt[1];
     BUF->seqno[2] = uip_connr->snd_nxt[2];
     BUF->seqno[3] = uip_connr->snd_nxt[3];
+#if UIP_SLIDING_WINDOW
+    if(uip_connr->incontroller && !(uip_flags & UIP_REXMIT)) {
+        /* Segments are in flight; this is the last of them, or goes after them */
+        uip_add32(BUF->seqno, uip_connr->len - (uip_len - UIP_IPTCPH_LEN));
+        BUF->seqno[0] = uip_acc32[0];
+        BUF->seqno[1] = uip_acc32[1];
+        BUF->seqno[2] = uip_acc32[2];
+        BUF->seqno[3] = uip_acc32[3];
+    }
+#endif /* UIP_SLIDING_WINDOW */
 
     BUF->proto = UIP_PROTO_TCP;
 
@@ -1818,7 +2028,13 @@ ip_send_nolen:
     BUF->ipid[1] = ipid & 0xff;
     /* Calculate IP checksum. */
     BUF->ipchksum = 0;
-    BUF->ipchksum = ~(uip_ipchksum());
+#if UIP_SPLIT
+    /* Unless the packet data is in the ethernet controller; uip_split_output() does that */
+    if(uip_appdata != NULL)
+#endif /* UIP_SPLIT */
+    {
+        BUF->ipchksum = ~(uip_ipchksum());
+    }
     UIP_DEBUG("uip_process(): uip ip_send_nolen, checksum 0x%x\n\r", uip_ipchksum());
 #endif /* UIP_CONF_IPV6 */
 
@@ -321,6 +321,23 @@ void uip_setipid(u16_t id);
 #define uip_periodic_conn(conn) do { uip_conn = conn; \
                                      uip_process(UIP_TIMER); } while (0)
 
+/**
+ * Retransmission timer processing for a connection identified by its
+ * number.
+ *
+ * This function must be called every UIP_FAST_TIMER_INTERVAL ms for
+ * each connection, like uip_periodic(); a segment that's due for
+ * retransmission is put in uip_buf. uip_periodic() doesn't retransmit
+ * by itself, it keeps the slower tasks like polling the application
+ * and timing out TIME_WAIT.
+ *
+ * \param conn The number of the connection.
+ *
+ * \hideinitializer
+ */
+#define uip_fastperiodic(conn) do { uip_conn = &uip_conns[conn]; \
+                                    uip_process(UIP_FAST_TIMER); } while (0)
+
 /**
  * Reuqest that a particular connection should be polled.
  *
@@ -506,6 +523,35 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, u16_t port);
  */
 #define uip_outstanding(conn) ((conn)->len)
 
+#if UIP_SLIDING_WINDOW
+/**
+ * Can another segment of 'size' bytes be sent right away?
+ *
+ * Payload that's in the ethernet controller RAM stays there until
+ * it's acknowledged, so when all outstanding data is in the
+ * controller, uip_send() with a NULL-pointer adds a segment behind
+ * what's in flight instead of retransmitting it. The remote host's
+ * window has to have room for it though. Retransmissions
+ * (uip_rexmit()) are for the oldest segment only.
+ *
+ * \hideinitializer
+ */
+#define uip_cansend(size) (!uip_outstanding(uip_conn) || \
+                           (uip_conn->incontroller && uip_conn->len + (size) <= uip_conn->wnd))
+
+/**
+ * Retransmit the oldest segment in flight, right away.
+ *
+ * When several segments are in flight (see uip_cansend()), an ACK
+ * can tell the next one is lost as well. Call this when that ACK
+ * comes in, and send that segment with uip_send() as for
+ * uip_rexmit().
+ *
+ * \hideinitializer
+ */
+#define uip_resend() (uip_flags |= UIP_REXMIT)
+#endif /* UIP_SLIDING_WINDOW */
+
 /**
  * Send data on the current connection.
  *
@@ -641,6 +687,15 @@ void uip_send(const void *data, int len);
  */
 #define uip_acked()   (uip_flags & UIP_ACKDATA)
 
+/**
+ * The no. of bytes acknowledged, when uip_acked() is non-zero.
+ *
+ * That's all outstanding data, unless there are several segments in
+ * flight (see uip_cansend()); then it can be any part of them,
+ * starting with the oldest.
+ */
+extern u16_t uip_acklen;
+
 /**
  * Has the connection just been connected?
  *
@@ -1126,6 +1181,19 @@ extern void *uip_urgdata;
  */
 extern u16_t uip_len;
 
+/**
+ * Set when only the headers of the received packet are in uip_buf.
+ *
+ * The device driver may leave the payload of a plain TCP segment (no
+ * IP or TCP options, no urgent data, no SYN, FIN or RST) in the
+ * ethernet controller RAM, and set this before calling the uIP input
+ * function; uip_len is the length of the whole packet nevertheless.
+ * It should only do so for the data an established connection expects
+ * next. The payload is then checked with uip_chksum_incontroller_rx(),
+ * and handed to the application with uip_appdata set to NULL.
+ */
+extern u8_t uip_incontroller_rx;
+
 /** @} */
 
 #if UIP_URGDATA > 0
@@ -1153,12 +1221,28 @@ struct uip_conn {
     u16_t len;              /**< Length of the data that was previously sent. */
     u16_t mss;              /**< Current maximum segment size for the connection. */
     u16_t initialmss;       /**< Initial maximum segment size for the connection. */
-    u8_t sa;                /**< Retransmission time-out calculation state variable. */
-    u8_t sv;                /**< Retransmission time-out calculation state variable. */
-    u8_t rto;               /**< Retransmission time-out. */
+    u16_t sa;               /**< Retransmission time-out calculation state variable; smoothed round trip time, in ms times 8. */
+    u16_t sv;               /**< Retransmission time-out calculation state variable; its mean deviation, in ms times 4. */
+    u16_t rto;              /**< Retransmission time-out, in ms. */
+    u16_t rtt;              /**< How long the segment that ends at rttseq has been in flight, in ms.. */
+    u16_t rttseq;           /**< ..the lower half of that sequence number.. */
+    u8_t rtttimed;          /**< ..valid when set; a segment that was retransmitted isn't timed (Karn). */
     u8_t tcpstateflags;     /**< TCP state and flags. */
-    u8_t timer;             /**< The retransmission timer. */
+    u16_t timer;            /**< The retransmission timer, in ms; TIME_WAIT counts periodic timer pulses in it. */
     u8_t nrtx;              /**< The number of retransmissions for the last segment sent. */
+#if UIP_SLIDING_WINDOW
+    u8_t incontroller;      /**< The outstanding data is in the ethernet controller, in one or more segments. */
+    u8_t dupacks;           /**< The number of duplicate ACKs for the oldest of those segments. */
+    u16_t wnd;              /**< Window advertised by the remote host. */
+#endif /* UIP_SLIDING_WINDOW */
+#if UIP_DELAYED_ACK
+    u16_t unacked;          /**< Data received since the last segment we sent.. */
+    u8_t ackdelay;          /**< ..and how much longer, in ms, the ACK for it can wait; 0 when it doesn't. */
+#endif /* UIP_DELAYED_ACK */
+#if UIP_SPLIT
+    u16_t ipsum;            /**< Sum of the IP header fields that are the same for each packet.. */
+    u16_t hdrsum;           /**< ..and of the TCP ones, with the pseudo-header; 0 until uip_split_output() needs them. */
+#endif /* UIP_SPLIT */
 
     /** The application state. */
     uip_tcp_appstate_t appstate;
@@ -1196,6 +1280,10 @@ struct uip_udp_conn {
     u16_t lport;            /**< The local port number in network byte order. */
     u16_t rport;            /**< The remote port number in network byte order. */
     u8_t  ttl;              /**< Default time-to-live. */
+#if UIP_SPLIT
+    u16_t ipsum;            /**< Sum of the IP header fields that are the same for each datagram.. */
+    u16_t hdrsum;           /**< ..and of the UDP ones, with the pseudo-header; 0 until uip_split_output() needs them. */
+#endif /* UIP_SPLIT */
 
     /** The application state. */
     uip_udp_appstate_t appstate;
@@ -1320,6 +1408,7 @@ void uip_process(u8_t flag);
 #if UIP_UDP
 #define UIP_UDP_TIMER     5
 #endif /* UIP_UDP */
+#define UIP_FAST_TIMER    6     /* Tells uIP that the retransmission timer has fired. */
 
 /* The TCP states used in the uip_conn->tcpstateflags. */
 #define UIP_CLOSED      0
@@ -1491,8 +1580,6 @@ struct uip_eth_addr {
     u8_t addr[6];
 };
 
-u16_t uip_chksum_bytes(u16_t sum, const u8_t *data, u16_t len);
-
 /**
  * Calculate the Internet checksum over a buffer.
  *
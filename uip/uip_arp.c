@@ -106,6 +106,7 @@ static const u16_t broadcast_ipaddr[2] = {0xffff,0xffff};
 
 static struct arp_entry arp_table[UIP_ARPTAB_SIZE];
 static u8_t i;
+static u8_t lastentry;  /* Entry the last packet went to; most likely the next one goes there too */
 
 static u8_t arptime;
 
@@ -294,14 +295,18 @@ void uip_arp_out(void)
             uip_ipaddr_copy(ipaddr, IPBUF->destipaddr);
         }
 
-        i = 0;
-        do {
-            tabptr = &arp_table[i];
-            if(uip_ipaddr_cmp(ipaddr, tabptr->ipaddr)) {
-                break;
-            }
-            i++;
-        } while(i<UIP_ARPTAB_SIZE);
+        i = lastentry;
+        tabptr = &arp_table[i];
+        if(!uip_ipaddr_cmp(ipaddr, tabptr->ipaddr)) {
+            i = 0;
+            do {
+                tabptr = &arp_table[i];
+                if(uip_ipaddr_cmp(ipaddr, tabptr->ipaddr)) {
+                    break;
+                }
+                i++;
+            } while(i<UIP_ARPTAB_SIZE);
+        }
 
         if(i == UIP_ARPTAB_SIZE) {
             /* The destination address was not in our ARP table, so we
@@ -329,6 +334,7 @@ void uip_arp_out(void)
         }
 
         /* Build an ethernet header. */
+        lastentry = i;
         memcpy(IPBUF->ethhdr.dest.addr, tabptr->ethaddr.addr, 6);
     }
     memcpy(IPBUF->ethhdr.src.addr, uip_ethaddr.addr, 6);
@@ -342,6 +348,29 @@ void uip_arp_out(void)
                 IPBUF->ethhdr.dest.addr[0], IPBUF->ethhdr.dest.addr[1], IPBUF->ethhdr.dest.addr[2], IPBUF->ethhdr.dest.addr[3],IPBUF->ethhdr.dest.addr[4], IPBUF->ethhdr.dest.addr[5] );
 }
 
+u8_t uip_arp_known(u16_t *destipaddr)
+{
+    u16_t ipaddr[2];
+
+    /* Same lookup as uip_arp_out() does. */
+    if(uip_ipaddr_cmp(destipaddr, broadcast_ipaddr)) {
+        return 1;
+    }
+    if(!uip_ipaddr_maskcmp(destipaddr, uip_hostaddr, uip_netmask)) {
+        uip_ipaddr_copy(ipaddr, uip_draddr);
+    }
+    else {
+        uip_ipaddr_copy(ipaddr, destipaddr);
+    }
+
+    for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
+        if(uip_ipaddr_cmp(ipaddr, arp_table[i].ipaddr)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /* Internal function, called from uip_arp_arpin() */
 static void uip_arp_update(u16_t *ipaddr, struct uip_eth_addr *ethaddr)
 {
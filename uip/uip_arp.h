@@ -92,6 +92,13 @@ void uip_arp_arpin(void);
    the Ethernet frame that should be transmitted. */
 void uip_arp_out(void);
 
+/* The uip_arp_known() function tells if uip_arp_out() would find the
+   Ethernet MAC address for an IP packet to the given destination, as
+   opposed to turning it into an ARP request. Applications that don't
+   retransmit, like UDP ones, can use it to hold on to what they send
+   until the address is resolved. */
+u8_t uip_arp_known(u16_t *destipaddr);
+
 /* The uip_arp_timer() function should be called every ten seconds. It
    is responsible for flushing old entries in the ARP table. */
 void uip_arp_timer(void);
@@ -41,14 +41,41 @@
 #include "uip.h"
 #include "uip_arp.h"
 #include "uip_arch.h"
-#include <string.h>
 
 #if UIP_SPLIT
 
 #define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UDPBUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+u16_t uip_split_incontroller_size = UIP_SPLIT_SIZE;
+u16_t uip_split_incontroller_offset;
 
 extern u16_t chksum(u16_t sum, const u8_t *data, u16_t len);
 
+#if UIP_SPLIT_SIZE & 1
+#error "UIP_SPLIT_SIZE should be even; each part of a split segment's payload is summed on its own"
+#endif
+
+static u16_t uip_split_add(u16_t sum, u16_t value)
+{
+    sum += value;
+    if(sum < value) {
+        sum++;
+    }
+    return sum;
+}
+
+static u16_t uip_split_update(u16_t checksum, u16_t old, u16_t new)
+{
+    u16_t sum;
+
+    /* RFC 1624; 'checksum' is a header checksum (network byte order)
+       over something in which 'old' became 'new' */
+    sum = uip_split_add(~htons(checksum), ~old);
+    sum = uip_split_add(sum, new);
+    return htons(~sum);
+}
+
 static void uip_split_ip(u16_t length)
 {
 #if UIP_CONF_IPV6
@@ -56,118 +83,200 @@ static void uip_split_ip(u16_t length)
     BUF->len[0] = ((length - UIP_IPH_LEN) >> 8);
     BUF->len[1] = ((length - UIP_IPH_LEN) & 0xff);
 #else /* UIP_CONF_IPV6 */
+    u16_t old = ((u16_t)BUF->len[0] << 8) + BUF->len[1];
+
     BUF->len[0] = length >> 8;
     BUF->len[1] = length & 0xff;
+
+    /* Update the IP checksum, for the new length. */
+    BUF->ipchksum = uip_split_update(BUF->ipchksum, old, length);
 #endif /* UIP_CONF_IPV6 */
+}
 
+/*
+ * Header templates, for packets with their payload in the ethernet
+ * controller. The header fields that are the same for each packet of
+ * a connection are summed once, when its first packet goes out; the
+ * sums are kept with the connection. After that the checksums only
+ * need the fields that change summed in: length and IP ID, sequence
+ * and acknowledgement numbers, flags and window. uip_conn or
+ * uip_udp_conn is the connection the packet in uip_buf is for.
+ */
+
+static void uip_split_template(u8_t proto, u16_t *ipsum, u16_t *hdrsum)
+{
+    if(*hdrsum != 0) {
+        return;
+    }
 #if !UIP_CONF_IPV6
-    /* Recalculate the IP checksum. */
+    /* Version and TOS, fragment offset, TTL and protocol, addresses */
+    *ipsum = chksum(0, &BUF->vhl, 2);
+    *ipsum = chksum(*ipsum, BUF->ipoffset, 4);
+    *ipsum = chksum(*ipsum, (u8_t *)&BUF->srcipaddr[0], 2 * sizeof(uip_ipaddr_t));
+#endif /* !UIP_CONF_IPV6 */
+    /* Protocol and addresses from the pseudoheader, ports. Never 0, as the protocol isn't */
+    *hdrsum = chksum(proto, (u8_t *)&BUF->srcipaddr[0], 2 * sizeof(uip_ipaddr_t));
+    *hdrsum = chksum(*hdrsum, (u8_t *)&BUF->srcport, 4);
+}
+
+static void uip_split_iptemplate(u16_t length, u16_t ipsum)
+{
+#if UIP_CONF_IPV6
+    (void)ipsum;
+    BUF->len[0] = ((length - UIP_IPH_LEN) >> 8);
+    BUF->len[1] = ((length - UIP_IPH_LEN) & 0xff);
+#else /* UIP_CONF_IPV6 */
+    u16_t sum;
+
+    BUF->len[0] = length >> 8;
+    BUF->len[1] = length & 0xff;
+
+    /* Length and IP ID */
     BUF->ipchksum = 0;
-    BUF->ipchksum = ~(uip_ipchksum());
+    sum = chksum(ipsum, BUF->len, 4);
+    BUF->ipchksum = ~( (sum == 0) ? 0xffff : htons(sum) );
 #endif /* UIP_CONF_IPV6 */
 }
 
-static void uip_split_tcp(u16_t checksum_payload)
+static void uip_split_tcp(u16_t length, u16_t checksum_payload)
 {
-    u16_t upper_layer_len, sum;
+    u16_t sum;
 
-    /* Recalculate the TCP checksum. */
+    /* IP header, then the TCP checksum; sequence and acknowledgement
+       numbers, offset, flags and window, and the length */
+    uip_split_iptemplate(length + UIP_TCPIP_HLEN, uip_conn->ipsum);
     BUF->tcpchksum = 0;
-#if UIP_CONF_IPV6
-    upper_layer_len = (((u16_t)(BUF->len[0]) << 8) + BUF->len[1]);
-#else /* UIP_CONF_IPV6 */
-    upper_layer_len = (((u16_t)(BUF->len[0]) << 8) + BUF->len[1]) - UIP_IPH_LEN;
-#endif /* UIP_CONF_IPV6 */
-    /* Sum pseudoheader */
-    sum = upper_layer_len + UIP_PROTO_TCP;
-    sum = chksum(sum, (u8_t *)&BUF->srcipaddr[0], 2 * sizeof(uip_ipaddr_t));
-    /* Sum TCP header. */
-    sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN], UIP_TCPH_LEN);
-    /* Add already calculated payload sum. */
-    sum += checksum_payload;
-    if(sum < checksum_payload) {
-        sum++;
-    }
+    sum = chksum(uip_conn->hdrsum, BUF->seqno, 12);
+    sum = uip_split_add(sum, length + UIP_TCPH_LEN);
+    sum = uip_split_add(sum, checksum_payload);
     BUF->tcpchksum = ~( (sum == 0) ? 0xffff : htons(sum) );
 }
 
+#if UIP_UDP
+static void uip_split_udp(u16_t length, u16_t checksum_payload)
+{
+#if UIP_UDP_CHECKSUMS
+    u16_t sum;
+#endif /* UIP_UDP_CHECKSUMS */
+
+    uip_split_iptemplate(length + UIP_IPUDPH_LEN, uip_udp_conn->ipsum);
+#if UIP_UDP_CHECKSUMS
+    /* The length is in the pseudoheader as well as in the UDP header */
+    UDPBUF->udpchksum = 0;
+    sum = uip_split_add(uip_udp_conn->hdrsum, length + UIP_UDPH_LEN);
+    sum = uip_split_add(sum, length + UIP_UDPH_LEN);
+    sum = uip_split_add(sum, checksum_payload);
+    UDPBUF->udpchksum = ~( (sum == 0) ? 0xffff : htons(sum) );
+    /* Zero means 'no checksum' for UDP. */
+    if(UDPBUF->udpchksum == 0) {
+        UDPBUF->udpchksum = 0xffff;
+    }
+#else /* UIP_UDP_CHECKSUMS */
+    (void)checksum_payload;
+#endif /* UIP_UDP_CHECKSUMS */
+}
+#endif /* UIP_UDP */
+
+void uip_split_forget(void)
+{
+    u8_t c;
+
+    for(c = 0; c < UIP_CONNS; ++c) {
+        uip_conns[c].hdrsum = 0;
+    }
+#if UIP_UDP
+    for(c = 0; c < UIP_UDP_CONNS; ++c) {
+        uip_udp_conns[c].hdrsum = 0;
+    }
+#endif /* UIP_UDP */
+}
+
 void uip_split_output(void)
 {
-    extern u16_t uip_tcpchksum_incontroller_1, uip_tcpchksum_incontroller_2;
-    extern u16_t uip_chksum_singlebytes;
     extern void *uip_appdata;
-    u16_t tcplen;
+    u16_t tcplen, offset;
 
     if(uip_appdata == NULL) {
-        /* appdata is a NULL-pointer, meaning it's already in the ethernet controller RAM.
-           TODO: we assume all 'incontroller' packets are TCP!!! */
+        /* appdata is a NULL-pointer, meaning it's already in the ethernet controller RAM. */
+        offset = uip_split_incontroller_offset;
+#if UIP_UDP
+        if(BUF->proto == UIP_PROTO_UDP) {
+            /* A datagram is never split. Payload checksum is calculated by the ethernet controller */
+            u16_t udplen = uip_len - UIP_IPUDPH_LEN - sizeof(struct uip_eth_hdr);
+
+            uip_split_template(UIP_PROTO_UDP, &uip_udp_conn->ipsum, &uip_udp_conn->hdrsum);
+            uip_split_udp(udplen, uip_chksum_incontroller(offset + 1 + UIP_IPUDPH_LEN + UIP_LLH_LEN, udplen));
+
+            /* Transmit package */
+            uip_output_incontroller(offset, UIP_IPUDPH_LEN + UIP_LLH_LEN, udplen);
+            return;
+        }
+#endif /* UIP_UDP */
         tcplen = uip_len - UIP_TCPIP_HLEN - sizeof(struct uip_eth_hdr);
+        uip_split_template(UIP_PROTO_TCP, &uip_conn->ipsum, &uip_conn->hdrsum);
 
-        if(tcplen > UIP_SPLIT_SIZE) {
-            /* Create first packet */
-            uip_split_ip(UIP_SPLIT_SIZE + UIP_TCPIP_HLEN);
-            uip_split_tcp(uip_tcpchksum_incontroller_1);
+        if(tcplen > uip_split_incontroller_size) {
+            /* Create first packet. Payload checksum is calculated by the ethernet controller */
+            uip_split_tcp(uip_split_incontroller_size, uip_chksum_incontroller(offset + 1 + UIP_IPTCPH_LEN + UIP_LLH_LEN, uip_split_incontroller_size));
 			
             /* Transmit first package */
-            uip_output_incontroller(0,
+            uip_output_incontroller(offset,
 			                        UIP_IPTCPH_LEN + UIP_LLH_LEN,
-									UIP_SPLIT_SIZE);
+									uip_split_incontroller_size);
 
-            /* Create second package */
-            uip_split_ip((tcplen - UIP_SPLIT_SIZE) + UIP_TCPIP_HLEN);
-            /* update the TCP sequence number */
-            uip_add32(BUF->seqno, UIP_SPLIT_SIZE);
+            /* Create second package; update the TCP sequence number */
+            uip_add32(BUF->seqno, uip_split_incontroller_size);
             BUF->seqno[0] = uip_acc32[0];
             BUF->seqno[1] = uip_acc32[1];
             BUF->seqno[2] = uip_acc32[2];
             BUF->seqno[3] = uip_acc32[3];
-			uip_split_tcp(uip_tcpchksum_incontroller_2);
+            uip_split_tcp(tcplen - uip_split_incontroller_size, uip_chksum_incontroller(offset + 1 + (UIP_IPTCPH_LEN + UIP_LLH_LEN) + uip_split_incontroller_size + UIP_SPLIT_INCONTROLLER_GAP + 1 + (UIP_IPTCPH_LEN + UIP_LLH_LEN),
+                                                  tcplen - uip_split_incontroller_size));
 
-            /* Transmit second package */
-            uip_output_incontroller(1 + (UIP_IPTCPH_LEN + UIP_LLH_LEN) + UIP_SPLIT_SIZE,
+            /* Transmit second package; it's queued behind the first one, so leave room for what
+               the controller writes after that */
+            uip_output_incontroller(offset + 1 + (UIP_IPTCPH_LEN + UIP_LLH_LEN) + uip_split_incontroller_size + UIP_SPLIT_INCONTROLLER_GAP,
                                     UIP_IPTCPH_LEN + UIP_LLH_LEN,
-                                    tcplen - UIP_SPLIT_SIZE);
+                                    tcplen - uip_split_incontroller_size);
         }
         else {
-            uip_split_tcp(uip_tcpchksum_incontroller_1);
+            uip_split_tcp(tcplen, uip_chksum_incontroller(offset + 1 + UIP_IPTCPH_LEN + UIP_LLH_LEN, tcplen));
 
             /* Transmit package */
-            uip_output_incontroller(0, UIP_IPTCPH_LEN + UIP_LLH_LEN, tcplen);
+            uip_output_incontroller(offset, UIP_IPTCPH_LEN + UIP_LLH_LEN, tcplen);
         }
-        uip_chksum_singlebytes = 0;  
     }
     else {
         /* We only split TCP segments that are larger than or equal to UIP_SPLIT_SIZE, which is configurable through UIP_SPLIT_CONF_SIZE. */
         if(BUF->proto == UIP_PROTO_TCP && uip_len >= UIP_SPLIT_SIZE + UIP_TCPIP_HLEN + sizeof(struct uip_eth_hdr)) {
+            u16_t second;
+
             tcplen = uip_len - UIP_TCPIP_HLEN - sizeof(struct uip_eth_hdr);
+            uip_split_template(UIP_PROTO_TCP, &uip_conn->ipsum, &uip_conn->hdrsum);
 
-            /* Create first packet */
+            /* The second half of the payload is the only part that's summed */
+            second = chksum(0, (u8_t *)uip_appdata + UIP_SPLIT_SIZE, tcplen - UIP_SPLIT_SIZE);
+
+            /* Create first packet; take the second half, and the difference in length, out
+               of the TCP checksum uip_process() calculated */
             uip_split_ip(UIP_SPLIT_SIZE + UIP_TCPIP_HLEN);
-            /* Recalculate the TCP checksum. */
-            BUF->tcpchksum = 0;
-            BUF->tcpchksum = ~(uip_tcpchksum());
-			
+            BUF->tcpchksum = uip_split_update(BUF->tcpchksum, second, 0);
+            BUF->tcpchksum = uip_split_update(BUF->tcpchksum, tcplen + UIP_TCPH_LEN, UIP_SPLIT_SIZE + UIP_TCPH_LEN);
+
             /* Transmit first package */
             uip_len = UIP_SPLIT_SIZE + UIP_TCPIP_HLEN + sizeof(struct uip_eth_hdr);
             uip_output();
-    
-            /* Create second package */
-            uip_split_ip((tcplen - UIP_SPLIT_SIZE) + UIP_TCPIP_HLEN);
-            /* Reshuffle payload */
-            memcpy(uip_appdata, (u8_t *)uip_appdata + UIP_SPLIT_SIZE, tcplen - UIP_SPLIT_SIZE);
-            /* update the TCP sequence number */
+
+            /* Create second package; update the TCP sequence number */
             uip_add32(BUF->seqno, UIP_SPLIT_SIZE);
             BUF->seqno[0] = uip_acc32[0];
             BUF->seqno[1] = uip_acc32[1];
             BUF->seqno[2] = uip_acc32[2];
             BUF->seqno[3] = uip_acc32[3];
-			/* Recalculate the TCP checksum. */
-            BUF->tcpchksum = 0;
-            BUF->tcpchksum = ~(uip_tcpchksum());
+            uip_split_tcp(tcplen - UIP_SPLIT_SIZE, second);
 
-            /* Transmit second package */
-            uip_len += sizeof(struct uip_eth_hdr);
-            uip_output();
+            /* Transmit second package, its payload from where it is */
+            uip_output_payload((u8_t *)uip_appdata + UIP_SPLIT_SIZE, tcplen - UIP_SPLIT_SIZE);
         }
         else {
             /* Packet not big enough (or not a TCP packet!) to make a split worthwhile, send as is. */
@@ -91,8 +91,33 @@
  */
 #if UIP_SPLIT
 void uip_split_output(void);
+
+/**
+ * Where a segment that's in the ethernet controller (uip_appdata is
+ * NULL) is split; its first packet carries this many bytes of
+ * payload. UIP_SPLIT_SIZE unless the application sets it, at most
+ * UIP_SPLIT_SIZE; UIP_SPLIT_NONE sends the segment as one packet.
+ * It should stay the same for retransmissions of the segment.
+ */
+extern u16_t uip_split_incontroller_size;
+#define UIP_SPLIT_NONE 0xFFFF
+
+/**
+ * Where in the ethernet controller's free buffer a segment or UDP
+ * datagram that's in the controller starts; the headers go there, the
+ * payload right after them. 0 unless the application sets it.
+ */
+extern u16_t uip_split_incontroller_offset;
+
+/**
+ * Forget the header templates of all connections (see uip_split.c);
+ * call it after changing uip_hostaddr, or the ripaddr or rport of a
+ * UDP connection.
+ */
+void uip_split_forget(void);
 #else
 #define uip_split_output uip_output
+#define uip_split_forget()
 #endif
 
 #endif /* __UIP_SPLIT_H__ */
@@ -273,19 +273,90 @@
 #define UIP_URGDATA      0
 
 /**
- * The initial retransmission timeout counted in timer pulses.
+ * How often, in ms, uip_fastperiodic() is called for each connection.
+ *
+ * The retransmission timer and the round trip time measurement run
+ * off this interval, so it's also their resolution.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_FAST_TIMER_INTERVAL
+#define UIP_FAST_TIMER_INTERVAL 10
+#else /* UIP_CONF_FAST_TIMER_INTERVAL */
+#define UIP_FAST_TIMER_INTERVAL UIP_CONF_FAST_TIMER_INTERVAL
+#endif /* UIP_CONF_FAST_TIMER_INTERVAL */
+
+/**
+ * The initial retransmission timeout in ms, until a round trip time
+ * has been measured.
  *
  * This should not be changed.
  */
-#define UIP_RTO         3
+#define UIP_RTO         1000
+
+/**
+ * The lowest retransmission timeout in ms, whatever the round trip
+ * time estimate is.
+ *
+ * On a LAN the estimate alone comes out at a few ms, far below the
+ * time peers hold back their ACK for a lone small segment (40 ms and
+ * up on Linux, 200 ms on Windows); the default covers that, so such
+ * a segment isn't sent again needlessly. Segments lost with others in
+ * flight are sent again sooner, by fast retransmit (see UIP_DUPACKS).
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_RTO_MIN
+#define UIP_RTO_MIN     200
+#else /* UIP_CONF_RTO_MIN */
+#define UIP_RTO_MIN     UIP_CONF_RTO_MIN
+#endif /* UIP_CONF_RTO_MIN */
+
+/**
+ * The highest retransmission timeout in ms; exponential backoff stops
+ * here.
+ */
+#define UIP_RTO_MAX     60000
 
 /**
  * The maximum number of times a segment should be retransmitted
  * before the connection should be aborted.
  *
- * This should not be changed.
+ * The timeout doubles with each retransmission, starting at as little
+ * as UIP_RTO_MIN; this gives a peer that's gone a few minutes.
+ */
+#define UIP_MAXRTX      12
+
+/**
+ * After this many duplicate ACKs, the oldest segment in flight is
+ * retransmitted right away (fast retransmit), instead of when the
+ * retransmission timer runs out.
+ *
+ * Only for connections with several segments in flight; see
+ * UIP_SLIDING_WINDOW.
+ *
+ * \hideinitializer
+ */
+#ifndef UIP_CONF_DUPACKS
+#define UIP_DUPACKS     3
+#else /* UIP_CONF_DUPACKS */
+#define UIP_DUPACKS     UIP_CONF_DUPACKS
+#endif /* UIP_CONF_DUPACKS */
+
+/**
+ * How long, in ms, the ACK for received data can wait for something
+ * to go with it; see UIP_DELAYED_ACK.
+ *
+ * RFC 1122 allows up to 500 ms. It's counted in UIP_FAST_TIMER_INTERVAL
+ * steps, and should stay below 256.
+ *
+ * \hideinitializer
  */
-#define UIP_MAXRTX      8
+#ifndef UIP_CONF_ACK_DELAY
+#define UIP_ACK_DELAY   40
+#else /* UIP_CONF_ACK_DELAY */
+#define UIP_ACK_DELAY   UIP_CONF_ACK_DELAY
+#endif /* UIP_CONF_ACK_DELAY */
 
 /**
  * The maximum number of times a SYN segment should be retransmitted
@@ -445,6 +516,14 @@ void uip_log(const char *msg);
  */
 void uip_output(void);
 
+/**
+ * Transmit packet with its ip/tcp header in uip_buf, and 'payload_length' bytes of
+ * payload from 'payload'
+ * 
+ * \hideinitializer
+ */
+void uip_output_payload(const u8_t *payload, const u16_t payload_length);
+
 /**
  * Transmit packet with payload data already in ethernet controller, ip/tcp header in uip_buf
  * 
@@ -452,6 +531,22 @@ void uip_output(void);
  */
 void uip_output_incontroller(const u16_t start_of_packet, const u8_t header_length, const u16_t payload_length);
 
+/**
+ * Checksum over payload data already in ethernet controller, as calculated by chksum()
+ * 
+ * \hideinitializer
+ */
+u16_t uip_chksum_incontroller(const u16_t offset, const u16_t length);
+
+/**
+ * Checksum over the 'length' bytes of payload of the received packet
+ * that were left in the ethernet controller (see uip_incontroller_rx),
+ * as calculated by chksum()
+ * 
+ * \hideinitializer
+ */
+u16_t uip_chksum_incontroller_rx(const u16_t length);
+
 /**
  * When enabled (UIP_SPLIT is set), outgoing TCP packets of UIP_SPLIT_CONF_SIZE byte or
  * more will be split in two.
@@ -466,6 +561,20 @@ void uip_output_incontroller(const u16_t start_of_packet, const u8_t header_leng
 #define UIP_SPLIT_SIZE UIP_TCP_MSS
 #endif /* UIP_SPLIT_CONF_SIZE */
 
+/**
+ * No. of bytes left free after the first half of a split segment
+ * that's in the ethernet controller RAM, before the second half
+ * starts. Lets the controller write whatever it writes after a
+ * transmitted packet while the second half waits for its turn.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_SPLIT_CONF_INCONTROLLER_GAP
+#define UIP_SPLIT_INCONTROLLER_GAP UIP_SPLIT_CONF_INCONTROLLER_GAP
+#else /* UIP_SPLIT_CONF_INCONTROLLER_GAP */
+#define UIP_SPLIT_INCONTROLLER_GAP 0
+#endif /* UIP_SPLIT_CONF_INCONTROLLER_GAP */
+
 /**
  * The link level header length.
  *